@@ -0,0 +1,281 @@
+// circlebench: headless throughput of the circle simulation over circle counts, densities and thread counts
+// usage: circlebench [--counts 16,64,...] [--densities 0.25,0.5,1] [--threads 1,2,...] [--steps N] [--warmup N]
+//                    [--seed S] [--scale-dt] [--csv path] [--json path]
+//        circlebench_soa adds [--soa], and circlebench_ccd adds [--soa] [--ccd]
+// the core benchmark depends only on cgmath.h and circle.h; the structure-of-arrays store (circle_soa.h) and
+// the continuous collisions (circle_ccd.h) are built only with CIRCLEBENCH_SOA and CIRCLEBENCH_CCD (see makefile)
+// density shrinks the walls around the circles of create_circles(); 1 is the interactive default, and area is the covered fraction of the walls
+// the radii of create_circles() shrink with sqrt(count), so a fixed dt moves the circles over more radii per step at larger counts;
+// --scale-dt shrinks dt with the radii (dt at 1024 circles), so the scaling rows at the end show the broad phase alone
+// every collision is elastic, so the kinetic energy must not grow; with --soa, the array-of-structures path reruns the same steps
+// and must produce the same bits (build without FMA contraction). a row with non-finite circles, energy growth or different bits
+// is rejected without its timings, and the run exits with a non-zero code
+#if defined(CIRCLEBENCH_CCD) && !defined(CIRCLEBENCH_SOA)
+	#define CIRCLEBENCH_SOA		// circle_ccd.h steps both stores
+#endif
+#include "cgmath.h"		// slee's simple math library
+#include "circle.h"		// circle class definition
+#if defined(CIRCLEBENCH_SOA)
+	#include "circle_soa.h"	// structure-of-arrays store
+#endif
+#if defined(CIRCLEBENCH_CCD)
+	#include "circle_ccd.h"	// sweep-and-prune and continuous collision detection
+#endif
+#include <chrono>
+#if defined(__linux__)
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+// hardware cache-miss counter of this process and the threads created after open(); unavailable without perf events
+struct cache_miss_counter
+{
+	int fd = -1;
+#if defined(__linux__)
+	void open()
+	{
+		perf_event_attr a; memset( &a, 0, sizeof(a) );
+		a.type = PERF_TYPE_HARDWARE; a.size = sizeof(a); a.config = PERF_COUNT_HW_CACHE_MISSES;
+		a.disabled = 1; a.inherit = 1; a.exclude_kernel = 1; a.exclude_hv = 1;
+		fd = int(syscall( __NR_perf_event_open, &a, 0, -1, -1, 0 ));
+	}
+	void enable(){ if(fd>=0) ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 ); }
+	void disable(){ if(fd>=0) ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 ); }
+	int64_t read_close(){ uint64_t v=0; bool b = fd>=0&&::read(fd,&v,sizeof(v))==sizeof(v); if(fd>=0) close(fd); fd=-1; return b?int64_t(v):-1; } // after inherited threads exit
+#else
+	void open(){}
+	void enable(){}
+	void disable(){}
+	int64_t read_close(){ return -1; }
+#endif
+};
+
+struct result_t
+{
+	uint	count, threads, steps;
+	float	density, area;		// inverse wall area relative to the default, and covered fraction of the walls
+	float	dt;					// timestep of the row
+	double	ns;					// per circle per step
+	double	pair_tests;			// per step
+	int64_t	cache_misses;		// per step; -1 if unavailable
+	double	energy;				// relative change of the kinetic energy over the warmup and measured steps
+};
+
+template <class T> static std::vector<T> parse_list( const char* s, T (*conv)(const char*) )
+{
+	std::vector<T> v; for( const char* p=s; p&&*p; p=strchr(p,',') ){ if(*p==',') p++; v.push_back(conv(p)); }
+	return v;
+}
+static uint		to_uint( const char* s ){ return uint(strtoul(s,nullptr,10)); }
+static float	to_float( const char* s ){ return float(atof(s)); }
+
+// kinetic energy of the circles with unit masses, as circle_t::resolve() treats them
+static double kinetic_energy( const std::vector<circle_t>& circles ){ double e=0; for( auto& c : circles ) e += double(c.velocity.x)*c.velocity.x+double(c.velocity.y)*c.velocity.y; return e*0.5; }
+static uint nonfinite_circles( const std::vector<circle_t>& circles ){ uint n=0; for( auto& c : circles ) n += !std::isfinite(c.pos.x+c.pos.y+c.velocity.x+c.velocity.y); return n; }
+#if defined(CIRCLEBENCH_SOA)
+static double kinetic_energy( const circle_soa& s ){ double e=0; for( size_t k=0, n=s.size(); k < n; k++ ) e += double(s.vx[k])*s.vx[k]+double(s.vy[k])*s.vy[k]; return e*0.5; }
+static uint nonfinite_circles( const circle_soa& s ){ uint n=0; for( size_t k=0, c=s.size(); k < c; k++ ) n += !std::isfinite(s.x[k]+s.y[k]+s.vx[k]+s.vy[k]); return n; }
+#endif
+
+#if defined(CIRCLEBENCH_CCD)
+// regression of the continuous collisions: A is deflected by B into C, which lies outside the swept bounds of A's straight path;
+// C must be hit within the same step, since A has passed through it by the next step
+static bool ccd_deflection_check()
+{
+	circle_ccd_t ccd;
+	ccd.p = { vec2(0,0), vec2(0.3f,0.08f), vec2(0.5f,-0.195f) };
+	ccd.v = { vec2(1,0), vec2(0), vec2(0) };
+	ccd.r = { 0.05f, 0.05f, 0.05f };
+	ccd.step( 0.4f, 10.0f, 10.0f );
+	bool b = ccd.events==2 && length(ccd.v[2])>0;
+	if(!b) printf( "> rejected: deflected circle passed through another (%zu events, C at velocity (%g,%g))\n", ccd.events, ccd.v[2].x, ccd.v[2].y );
+	return b;
+}
+#endif
+
+// circles of a row in the store and the collision phase selected by the options
+struct bench_circles_t
+{
+	bool					b_soa = false, b_ccd = false;
+	std::vector<circle_t>	circles;
+	circle_grid_t			grid;
+#if defined(CIRCLEBENCH_SOA)
+	circle_soa				soa;
+#endif
+#if defined(CIRCLEBENCH_CCD)
+	circle_ccd_t			ccd;
+#endif
+
+	void step( float t, float dt, float bound, worker_pool* pool )
+	{
+	#if defined(CIRCLEBENCH_CCD)
+		if(b_ccd&&b_soa){ ccd.update( soa, t, dt, bound, bound ); return; }
+	#endif
+	#if defined(CIRCLEBENCH_SOA)
+		if(b_soa){ soa.update( t, dt, bound, bound, &grid, pool ); return; }
+	#endif
+		step_aos( t, dt, bound, pool );
+	}
+	void step_aos( float t, float dt, float bound, worker_pool* pool )
+	{
+	#if defined(CIRCLEBENCH_CCD)
+		if(b_ccd){ ccd.update( circles, t, dt, bound, bound ); return; }
+	#endif
+		simulate_circles( circles, t, dt, bound, bound, &grid, pool );
+	}
+#if defined(CIRCLEBENCH_SOA)
+	double	energy() const { return b_soa ? kinetic_energy(soa) : kinetic_energy(circles); }
+	uint	nonfinite() const { return b_soa ? nonfinite_circles(soa) : nonfinite_circles(circles); }
+#else
+	double	energy() const { return kinetic_energy(circles); }
+	uint	nonfinite() const { return nonfinite_circles(circles); }
+#endif
+};
+
+int main( int argc, char* argv[] )
+{
+	std::vector<uint>	counts = { 16, 64, 256, 1<<10, 1<<12, 1<<14, 1<<16, 1<<18, 1<<20 };
+	std::vector<float>	densities = { 0.25f, 0.5f, 1.0f };
+	std::vector<uint>	threads;
+	uint				steps = 0, warmup = 0; // 0: scaled by count
+	uint64_t			seed = 0;
+	bool				b_soa = false, b_ccd = false, b_scale_dt = false, b_failed = false;
+	const double		max_energy_growth = 1e-4; // rounding of the elastic exchanges
+	const char			*csv_path = nullptr, *json_path = nullptr;
+	for( uint n=1, hw=std::max(1u,std::thread::hardware_concurrency()); n <= hw; n=n*2>hw&&n<hw?hw:n*2 ) threads.push_back(n);
+
+	for( int k=1; k < argc; k++ )
+	{
+		const char *a=argv[k], *v=k+1<argc?argv[k+1]:nullptr;
+	#if defined(CIRCLEBENCH_SOA)
+		if(strcmp(a,"--soa")==0){ b_soa = true; continue; }
+	#endif
+	#if defined(CIRCLEBENCH_CCD)
+		if(strcmp(a,"--ccd")==0){ b_ccd = true; continue; }
+	#endif
+		if(strcmp(a,"--soa")==0||strcmp(a,"--ccd")==0){ printf( "%s(): %s is not built in; use circlebench_soa or circlebench_ccd\n", __func__, a ); return 1; }
+		if(strcmp(a,"--scale-dt")==0){ b_scale_dt = true; continue; }
+		if(!v){ printf( "%s(): %s requires a value\n", __func__, a ); return 1; }
+		if(strcmp(a,"--counts")==0)			counts = parse_list(v,to_uint);
+		else if(strcmp(a,"--densities")==0)	densities = parse_list(v,to_float);
+		else if(strcmp(a,"--threads")==0)	threads = parse_list(v,to_uint);
+		else if(strcmp(a,"--steps")==0)		steps = to_uint(v);
+		else if(strcmp(a,"--warmup")==0)	warmup = to_uint(v);
+		else if(strcmp(a,"--seed")==0)		seed = strtoull(v,nullptr,10);
+		else if(strcmp(a,"--csv")==0)		csv_path = v;
+		else if(strcmp(a,"--json")==0)		json_path = v;
+		else { printf( "%s(): unknown option %s\n", __func__, a ); return 1; }
+		k++;
+	}
+
+	// the same step as the fixed-timestep simulation of a1
+	fixed_step_t stepper;
+	const float dt = b_ccd ? stepper.step : stepper.substep();
+
+	printf( "> %s circle store, %s, dt = %g%s\n", b_soa?"structure-of-arrays":"array-of-structures", b_ccd?"sweep and prune with continuous collisions":"uniform-grid broad phase", dt, b_scale_dt?" at 1024 circles":"" );
+#if defined(CIRCLEBENCH_CCD)
+	if(b_ccd&&!ccd_deflection_check()) b_failed = true;
+#endif
+	printf( "%8s %8s %7s %7s %7s %12s %14s %14s %9s\n", "count", "density", "area", "threads", "steps", "ns/circ/step", "pairs/step", "misses/step", "energy" );
+
+	std::vector<result_t> results;
+	for( uint count : counts ) for( float density : densities ) for( uint nt : threads )
+	{
+		if(!count||!nt||density<=0) continue;
+		uint ms = steps?steps:std::max(10u,std::min(1000u,(1u<<20)/count)), mw = warmup?warmup:std::max(2u,ms/10);
+		float bound = 1.0f/sqrt(density), h = b_scale_dt ? dt*sqrtf(1024.0f/count) : dt;
+		bench_circles_t bc; bc.b_soa = b_soa; bc.b_ccd = b_ccd;
+		bc.circles = create_circles( count, bound, bound, seed );
+		if(bc.circles.size()<count) continue; // create_circles() reports why
+	#if defined(CIRCLEBENCH_SOA)
+		if(b_soa) bc.soa.assign( bc.circles );
+	#endif
+		float area = 0; for( auto& c : bc.circles ) area += PI*c.radius*c.radius; area /= bound*bound*4;
+		double e0 = kinetic_energy( bc.circles );
+
+		// the counter opens before the pool to inherit its threads
+		cache_miss_counter counter; counter.open();
+		double sec; size_t tests;
+		{
+			worker_pool pool(nt);
+			for( uint k=1; k <= mw; k++ ) bc.step( h*k, h, bound, &pool );
+			collision_stats_t::instance().pair_tests = 0;
+			counter.enable();
+			auto t0 = std::chrono::steady_clock::now();
+			for( uint k=mw+1; k <= mw+ms; k++ ) bc.step( h*k, h, bound, &pool );
+			sec = std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+			counter.disable();
+			tests = collision_stats_t::instance().pair_tests;
+		}
+		int64_t misses = counter.read_close();
+
+		// a blown-up state makes the timings meaningless (e.g., NaNs collapse the grid into one cell)
+		uint nonfinite = bc.nonfinite();
+		double energy = bc.energy()/e0-1.0;
+
+		// the structure-of-arrays store must reproduce the array-of-structures path bit by bit
+		bool b_match = true;
+	#if defined(CIRCLEBENCH_SOA)
+		if(b_soa&&!nonfinite)
+		{
+			worker_pool pool(nt);
+			for( uint k=1; k <= mw+ms; k++ ) bc.step_aos( h*k, h, bound, &pool );
+			b_match = circle_state_hash(bc.circles)==circle_state_hash(bc.soa);
+		}
+	#endif
+
+		// only a stable step reports its timings
+		const char* reject = nonfinite ? "non-finite circles" : !(energy <= max_energy_growth) ? "kinetic energy grew" : !b_match ? "different bits from the array-of-structures path" : nullptr;
+		if(reject)
+		{
+			printf( "%8u %8.2f %7.3f %7u %7u rejected: %s (%u non-finite circles, energy %+.1e)\n", count, density, area, nt, ms, reject, nonfinite, energy );
+			fflush( stdout );
+			b_failed = true;
+			continue;
+		}
+
+		result_t r = { count, nt, ms, density, area, h, sec*1e9/(double(count)*ms), double(tests)/ms, misses<0?-1:misses/ms, energy };
+		results.push_back(r);
+		printf( "%8u %8.2f %7.3f %7u %7u %12.2f %14.0f ", r.count, r.density, r.area, r.threads, r.steps, r.ns, r.pair_tests );
+		if(r.cache_misses<0) printf( "%14s", "n/a" ); else printf( "%14lld", (long long)r.cache_misses );
+		printf( " %+9.1e\n", r.energy );
+		fflush( stdout );
+	}
+
+	// scaling rows: exponent of the pair tests per step over the counts; near 1 is linear in the number of circles
+	for( float density : densities ) for( uint nt : threads )
+	{
+		const result_t *r0=nullptr, *r1=nullptr;
+		for( auto& r : results ) if(r.density==density&&r.threads==nt){ if(!r0||r.count<r0->count) r0=&r; if(!r1||r.count>r1->count) r1=&r; }
+		if(!r0||r0->count==r1->count||r0->pair_tests<=0) continue;
+		printf( "> scaling at density %.2f with %u threads: pairs/step ~ count^%.2f from %u to %u circles\n", density, nt, log(r1->pair_tests/r0->pair_tests)/log(double(r1->count)/r0->count), r0->count, r1->count );
+	}
+
+	if(csv_path)
+	{
+		FILE* fp = fopen( csv_path, "w" ); if(!fp){ printf( "%s(): unable to open %s\n", __func__, csv_path ); return 1; }
+		fprintf( fp, "store,ccd,count,density,area,dt,threads,steps,ns_per_circle_step,pair_tests_per_step,cache_misses_per_step,energy_change\n" );
+		for( auto& r : results ) fprintf( fp, "%s,%d,%u,%g,%g,%g,%u,%u,%g,%g,%lld,%g\n", b_soa?"soa":"aos", int(b_ccd), r.count, r.density, r.area, r.dt, r.threads, r.steps, r.ns, r.pair_tests, (long long)r.cache_misses, r.energy );
+		fclose( fp );
+		printf( "> results written to %s\n", csv_path );
+	}
+
+	if(json_path)
+	{
+		FILE* fp = fopen( json_path, "w" ); if(!fp){ printf( "%s(): unable to open %s\n", __func__, json_path ); return 1; }
+		fprintf( fp, "{\n\t\"store\": \"%s\",\n\t\"ccd\": %s,\n\t\"dt\": %g,\n\t\"scale_dt\": %s,\n\t\"seed\": %llu,\n\t\"results\": [\n", b_soa?"soa":"aos", b_ccd?"true":"false", dt, b_scale_dt?"true":"false", (unsigned long long)seed );
+		for( size_t k=0; k < results.size(); k++ )
+		{
+			const result_t& r = results[k];
+			fprintf( fp, "\t\t{ \"count\": %u, \"density\": %g, \"area\": %g, \"dt\": %g, \"threads\": %u, \"steps\": %u, \"ns_per_circle_step\": %g, \"pair_tests_per_step\": %g, \"cache_misses_per_step\": %s, \"energy_change\": %g }%s\n",
+				r.count, r.density, r.area, r.dt, r.threads, r.steps, r.ns, r.pair_tests, r.cache_misses<0?"null":std::to_string(r.cache_misses).c_str(), r.energy, k+1<results.size()?",":"" );
+		}
+		fprintf( fp, "\t]\n}\n" );
+		fclose( fp );
+		printf( "> results written to %s\n", json_path );
+	}
+
+	return b_failed ? 1 : 0;
+}
\ No newline at end of file
@@ -7,15 +7,15 @@
 
 // inputs from vertex shader
 in vec2 tc;	// used for texture coordinate visualization
+in vec4 color;	// circle color
 
 // output of the fragment shader
 out vec4 fragColor;
 
 // shader's global variables, called the uniform variables
 uniform bool b_solid_color;
-uniform vec4 solid_color;
 
 void main()
 {
-	fragColor = b_solid_color ? solid_color : vec4(tc.xy,0,1);
+	fragColor = b_solid_color ? color : vec4(tc.xy,0,1);
 }
\ No newline at end of file
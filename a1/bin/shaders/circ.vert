@@ -3,20 +3,35 @@ layout(location=0) in vec3 position;
 layout(location=1) in vec3 normal;
 layout(location=2) in vec2 texcoord;
 
+// per-instance attributes for instanced rendering
+layout(location=3) in vec4 instance;		// (x, y, radius, theta) of a circle
+layout(location=4) in vec4 instance_color;	// RGBA color of a circle
+
 // outputs of vertex shader = input to fragment shader
 // out vec4 gl_Position: a built-in output variable that should be written in main()
 out vec3 norm;	// the second output: not used yet
 out vec2 tc;	// the third output: not used yet
+out vec4 color;	// circle color
 
 // uniform variables
 uniform mat4	model_matrix;	// 4x4 transformation matrix: explained later in the lecture
 uniform mat4	aspect_matrix;	// tricky 4x4 aspect-correction matrix
+uniform vec4	solid_color;	// per-circle color without instancing
+uniform bool	b_instanced;	// use per-instance attributes instead of model_matrix and solid_color
 
 void main()
 {
-	gl_Position = aspect_matrix*model_matrix*vec4(position,1);
+	mat4 m = model_matrix;
+	if(b_instanced)
+	{
+		// M = TRS from the instance attributes; GLSL constructors are column-major
+		float c = cos(instance.w)*instance.z, s = sin(instance.w)*instance.z;
+		m = mat4( c, s, 0, 0, -s, c, 0, 0, 0, 0, 1, 0, instance.x, instance.y, 0, 1 );
+	}
+	gl_Position = aspect_matrix*m*vec4(position,1);
 
 	// other outputs to rasterizer/fragment shader
 	norm = normal;
 	tc = texcoord;
+	color = b_instanced ? instance_color : solid_color;
 }
\ No newline at end of file
@@ -62,6 +62,38 @@
 #if defined(__GNUC__)&&__cplusplus<201402L
 	#error legacy C++11 is not used. Use -std=c++17 (or -std=c++14)
 #endif
+// SIMD instruction sets for mat4 products are selected at compile time (e.g., -mavx or /arch:AVX);
+// define CGMATH_NO_SIMD to use the scalar fallback
+#if !defined(CGMATH_NO_SIMD)
+	#if defined(__AVX__)
+		#define CGMATH_AVX
+		#include <immintrin.h>
+	#elif defined(__SSE2__)||defined(_M_X64)||(defined(_M_IX86_FP)&&_M_IX86_FP>=2)
+		#define CGMATH_SSE
+		#include <emmintrin.h>
+	#elif (defined(__ARM_NEON)&&defined(__aarch64__))||defined(_M_ARM64)
+		#define CGMATH_NEON
+		#include <arm_neon.h>
+	#endif
+#endif
+// constant evaluation of mat4 products takes the scalar code, and SIMD code runs only at run time;
+// compilers without __builtin_is_constant_evaluated() cannot evaluate SIMD products at compile time
+#if defined(__clang__)||(defined(__GNUC__)&&__GNUC__>=9)||(defined(_MSC_VER)&&_MSC_VER>=1925)
+	#define _cgmath_constant_evaluated() __builtin_is_constant_evaluated()
+	#define CGMATH_CONSTEXPR_SIMD
+#else
+	#define _cgmath_constant_evaluated() false
+#endif
+// define CGMATH_ALIGN16 to align mat4 at 16-byte boundaries for aligned SIMD loads/stores
+#if defined(CGMATH_ALIGN16)
+	#define CGMATH_ALIGN alignas(16)
+	#define _cgmath_load_ps _mm_load_ps
+	#define _cgmath_store_ps _mm_store_ps
+#else
+	#define CGMATH_ALIGN
+	#define _cgmath_load_ps _mm_loadu_ps
+	#define _cgmath_store_ps _mm_storeu_ps
+#endif
 
 //*******************************************************************
 // user types
@@ -84,21 +116,21 @@ template <class T> struct tvec2
 	union{ struct { T x, y; }; struct { T r, g; }; struct { T s, t; }; };
 
 	// constructor/set
-	tvec2(){ x=y=0; }
-	tvec2( T a ){ x=y=a; }						inline void set( T a ){ x=y=a; }
-	tvec2( T a, T b ){ x=a;y=b; }				inline void set( T a, T b ){ x=a;y=b; }
-	tvec2( const tvec2& v ){ x=v.x;y=v.y; }		inline void set( const tvec2& v ){ x=v.x;y=v.y; }
+	constexpr tvec2():x(0),y(0){}
+	constexpr tvec2( T a ):x(a),y(a){}			constexpr void set( T a ){ x=y=a; }
+	constexpr tvec2( T a, T b ):x(a),y(b){}		constexpr void set( T a, T b ){ x=a;y=b; }
+	constexpr tvec2( const tvec2& v ) = default;	constexpr void set( const tvec2& v ){ x=v.x;y=v.y; }
 
 	// assignment / compound assignment operators
-	inline tvec2& operator=( T a ){ set(a); return *this; }
-	inline tvec2& operator+=( const tvec2& v ){ x+=v.x; y+=v.y; return *this; }
-	inline tvec2& operator-=( const tvec2& v ){ x-=v.x; y-=v.y; return *this; }
-	inline tvec2& operator*=( const tvec2& v ){ x*=v.x; y*=v.y; return *this; }
-	inline tvec2& operator/=( const tvec2& v ){ x/=v.x; y/=v.y; return *this; }
-	inline tvec2& operator+=( T a ){ x+=a; y+=a; return *this; }
-	inline tvec2& operator-=( T a ){ x-=a; y-=a; return *this; }
-	inline tvec2& operator*=( T a ){ x*=a; y*=a; return *this; }
-	inline tvec2& operator/=( T a ){ x/=a; y/=a; return *this; }
+	constexpr tvec2& operator=( T a ){ set(a); return *this; }
+	constexpr tvec2& operator+=( const tvec2& v ){ x+=v.x; y+=v.y; return *this; }
+	constexpr tvec2& operator-=( const tvec2& v ){ x-=v.x; y-=v.y; return *this; }
+	constexpr tvec2& operator*=( const tvec2& v ){ x*=v.x; y*=v.y; return *this; }
+	constexpr tvec2& operator/=( const tvec2& v ){ x/=v.x; y/=v.y; return *this; }
+	constexpr tvec2& operator+=( T a ){ x+=a; y+=a; return *this; }
+	constexpr tvec2& operator-=( T a ){ x-=a; y-=a; return *this; }
+	constexpr tvec2& operator*=( T a ){ x*=a; y*=a; return *this; }
+	constexpr tvec2& operator/=( T a ){ x/=a; y/=a; return *this; }
 
 	// comparison operators
 	inline bool operator==( const tvec2& v ) const { return std::abs(x-v.x)<=precision<T>::value()&&std::abs(y-v.y)<=precision<T>::value(); }
@@ -115,24 +147,24 @@ template <class T> struct tvec2
 	inline const T& at( ptrdiff_t i ) const { return (&r)[i]; }
 
 	// unary operators
-	inline tvec2 operator+() const { return tvec2(r, g); }
-	inline tvec2 operator-() const { return tvec2(-r, -g); }
+	constexpr tvec2 operator+() const { return tvec2(x, y); }
+	constexpr tvec2 operator-() const { return tvec2(-x, -y); }
 
 	// binary operators
-	inline tvec2 operator+( const tvec2& v ) const { return tvec2(r+v.r, g+v.g); }
-	inline tvec2 operator-( const tvec2& v ) const { return tvec2(r-v.r, g-v.g); }
-	inline tvec2 operator*( const tvec2& v ) const { return tvec2(r*v.r, g*v.g); }
-	inline tvec2 operator/( const tvec2& v ) const { return tvec2(r/v.r, g/v.g);  }
-	inline tvec2 operator+( T a ) const { return tvec2(r+a, g+a); }
-	inline tvec2 operator-( T a ) const { return tvec2(r-a, g-a); }
-	inline tvec2 operator*( T a ) const { return tvec2(r*a, g*a); }
-	inline tvec2 operator/( T a ) const { return tvec2(r/a, g/a); }
+	constexpr tvec2 operator+( const tvec2& v ) const { return tvec2(x+v.x, y+v.y); }
+	constexpr tvec2 operator-( const tvec2& v ) const { return tvec2(x-v.x, y-v.y); }
+	constexpr tvec2 operator*( const tvec2& v ) const { return tvec2(x*v.x, y*v.y); }
+	constexpr tvec2 operator/( const tvec2& v ) const { return tvec2(x/v.x, y/v.y);  }
+	constexpr tvec2 operator+( T a ) const { return tvec2(x+a, y+a); }
+	constexpr tvec2 operator-( T a ) const { return tvec2(x-a, y-a); }
+	constexpr tvec2 operator*( T a ) const { return tvec2(x*a, y*a); }
+	constexpr tvec2 operator/( T a ) const { return tvec2(x/a, y/a); }
 
 	// length, normalize, dot product
-	float_memfun(U) inline T length() const { return (T)(sqrt(r*r+g*g)); }
-	float_memfun(U) inline T dot( const tvec2& v ) const { return (T)(r*v.r+g*v.g); }
-	float_memfun(U) inline tvec2 normalize() const { return tvec2(r, g)/length(); }
-	float_memfun(U) inline T length2() const { return (T)(r*r+g*g); }
+	float_memfun(U) inline T length() const { return (T)(sqrt(x*x+y*y)); }
+	float_memfun(U) constexpr T dot( const tvec2& v ) const { return (T)(x*v.x+y*v.y); }
+	float_memfun(U) inline tvec2 normalize() const { return tvec2(x, y)/length(); }
+	float_memfun(U) constexpr T length2() const { return (T)(x*x+y*y); }
 };
 
 //*******************************************************************
@@ -141,23 +173,23 @@ template <class T> struct tvec3
 	union { struct { T x, y, z; }; struct { T r, g, b; }; struct { T s, t, p; }; };
 
 	// constructor/set
-	tvec3(){ x=y=z=0; }
-	tvec3( T a ){ x=y=z=a; }								inline void set( T a ){ x=y=z=a; }
-	tvec3( T a, T b, T c ){ x=a;y=b;z=c; }					inline void set( T a, T b, T c ){ x=a;y=b;z=c; }
-	tvec3( const tvec3& v ){ x=v.x;y=v.y;z=v.z; }			inline void set( const tvec3& v ){ x=v.x;y=v.y;z=v.z; }
-	tvec3( const tvec2<T>& v, T c ){ x=v.x;y=v.y;z=c; }		inline void set( const tvec2<T>& v, T c ){ x=v.x;y=v.y;z=c; }
-	tvec3( T a, const tvec2<T>& v ){ x=a;y=v.x;z=v.y; }		inline void set( T a, const tvec2<T>& v ){ x=a;y=v.x;z=v.y; }
+	constexpr tvec3():x(0),y(0),z(0){}
+	constexpr tvec3( T a ):x(a),y(a),z(a){}					constexpr void set( T a ){ x=y=z=a; }
+	constexpr tvec3( T a, T b, T c ):x(a),y(b),z(c){}		constexpr void set( T a, T b, T c ){ x=a;y=b;z=c; }
+	constexpr tvec3( const tvec3& v ) = default;			constexpr void set( const tvec3& v ){ x=v.x;y=v.y;z=v.z; }
+	constexpr tvec3( const tvec2<T>& v, T c ):x(v.x),y(v.y),z(c){}	constexpr void set( const tvec2<T>& v, T c ){ x=v.x;y=v.y;z=c; }
+	constexpr tvec3( T a, const tvec2<T>& v ):x(a),y(v.x),z(v.y){}	constexpr void set( T a, const tvec2<T>& v ){ x=a;y=v.x;z=v.y; }
 
 	// assignment / compound assignment operators
-	inline tvec3& operator=( T a ){ set(a); return *this; }
-	inline tvec3& operator+=( const tvec3& v ){ x+=v.x; y+=v.y; z+=v.z; return *this; }
-	inline tvec3& operator-=( const tvec3& v ){ x-=v.x; y-=v.y; z-=v.z; return *this; }
-	inline tvec3& operator*=( const tvec3& v ){ x*=v.x; y*=v.y; z*=v.z; return *this; }
-	inline tvec3& operator/=( const tvec3& v ){ x/=v.x; y/=v.y; z/=v.z; return *this; }
-	inline tvec3& operator+=( T a ){ x+=a; y+=a; z+=a; return *this; }
-	inline tvec3& operator-=( T a ){ x-=a; y-=a; z-=a; return *this; }
-	inline tvec3& operator*=( T a ){ x*=a; y*=a; z*=a; return *this; }
-	inline tvec3& operator/=( T a ){ x/=a; y/=a; z/=a; return *this; }
+	constexpr tvec3& operator=( T a ){ set(a); return *this; }
+	constexpr tvec3& operator+=( const tvec3& v ){ x+=v.x; y+=v.y; z+=v.z; return *this; }
+	constexpr tvec3& operator-=( const tvec3& v ){ x-=v.x; y-=v.y; z-=v.z; return *this; }
+	constexpr tvec3& operator*=( const tvec3& v ){ x*=v.x; y*=v.y; z*=v.z; return *this; }
+	constexpr tvec3& operator/=( const tvec3& v ){ x/=v.x; y/=v.y; z/=v.z; return *this; }
+	constexpr tvec3& operator+=( T a ){ x+=a; y+=a; z+=a; return *this; }
+	constexpr tvec3& operator-=( T a ){ x-=a; y-=a; z-=a; return *this; }
+	constexpr tvec3& operator*=( T a ){ x*=a; y*=a; z*=a; return *this; }
+	constexpr tvec3& operator/=( T a ){ x/=a; y/=a; z/=a; return *this; }
 
 	// comparison operators
 	inline bool operator==( const tvec3& v ) const { return std::abs(x-v.x)<=precision<T>::value()&&std::abs(y-v.y)<=precision<T>::value()&&std::abs(z-v.z)<=precision<T>::value(); }
@@ -174,27 +206,27 @@ template <class T> struct tvec3
 	inline const T& at( ptrdiff_t i ) const { return (&r)[i]; }
 
 	// unary operators
-	inline tvec3 operator+() const { return tvec3(r, g, b); }
-	inline tvec3 operator-() const { return tvec3(-r, -g, -b); }
+	constexpr tvec3 operator+() const { return tvec3(x, y, z); }
+	constexpr tvec3 operator-() const { return tvec3(-x, -y, -z); }
 
 	// binary operators
-	inline tvec3 operator+( const tvec3& v ) const { return tvec3(r+v.r, g+v.g, b+v.b); }
-	inline tvec3 operator-( const tvec3& v ) const { return tvec3(r-v.r, g-v.g, b-v.b); }
-	inline tvec3 operator*( const tvec3& v ) const { return tvec3(r*v.r, g*v.g, b*v.b); }
-	inline tvec3 operator/( const tvec3& v ) const { return tvec3(r/v.r, g/v.g, b/v.b); }
-	inline tvec3 operator+( T a ) const { return tvec3(r+a, g+a, b+a); }
-	inline tvec3 operator-( T a ) const { return tvec3(r-a, g-a, b-a); }
-	inline tvec3 operator*( T a ) const { return tvec3(r*a, g*a, b*a); }
-	inline tvec3 operator/( T a ) const { return tvec3(r/a, g/a, b/a); }
+	constexpr tvec3 operator+( const tvec3& v ) const { return tvec3(x+v.x, y+v.y, z+v.z); }
+	constexpr tvec3 operator-( const tvec3& v ) const { return tvec3(x-v.x, y-v.y, z-v.z); }
+	constexpr tvec3 operator*( const tvec3& v ) const { return tvec3(x*v.x, y*v.y, z*v.z); }
+	constexpr tvec3 operator/( const tvec3& v ) const { return tvec3(x/v.x, y/v.y, z/v.z); }
+	constexpr tvec3 operator+( T a ) const { return tvec3(x+a, y+a, z+a); }
+	constexpr tvec3 operator-( T a ) const { return tvec3(x-a, y-a, z-a); }
+	constexpr tvec3 operator*( T a ) const { return tvec3(x*a, y*a, z*a); }
+	constexpr tvec3 operator/( T a ) const { return tvec3(x/a, y/a, z/a); }
 
 	// length, normalize, dot product
-	float_memfun(U) inline T length() const { return (T)(sqrt(r*r+g*g+b*b));}
-	float_memfun(U) inline tvec3 normalize() const { return tvec3(r, g, b)/length(); }
-	float_memfun(U) inline T dot( const tvec3& v ) const { return (T)(r*v.r+g*v.g+b*v.b); }
-	float_memfun(U) inline T length2() const { return (T)(r*r+g*g+b*b);}
+	float_memfun(U) inline T length() const { return (T)(sqrt(x*x+y*y+z*z));}
+	float_memfun(U) inline tvec3 normalize() const { return tvec3(x, y, z)/length(); }
+	float_memfun(U) constexpr T dot( const tvec3& v ) const { return (T)(x*v.x+y*v.y+z*v.z); }
+	float_memfun(U) constexpr T length2() const { return (T)(x*x+y*y+z*z);}
 
 	// tvec3 only: cross product
-	float_memfun(U) inline tvec3 cross( const tvec3& v ) const { return tvec3( g*v.b-b*v.g, b*v.r-r*v.b, r*v.g-g*v.r); }
+	float_memfun(U) constexpr tvec3 cross( const tvec3& v ) const { return tvec3( y*v.z-z*v.y, z*v.x-x*v.z, x*v.y-y*v.x); }
 };
 
 //*******************************************************************
@@ -203,27 +235,27 @@ template <class T> struct tvec4
 	union { struct { T x, y, z, w; }; struct { T r, g, b, a; }; struct { T s, t, p, q; }; };
 
 	// constructor/set
-	tvec4(){ x=y=z=w=0; }
-	tvec4( T a ){ x=y=z=w=a; }										inline void set( T a ){ x=y=z=w=a; }
-	tvec4( T a, T b, T c, T d ){ x=a;y=b;z=c;w=d; }					inline void set( T a, T b, T c, T d ){ x=a;y=b;z=c;w=d; }
-	tvec4( const tvec4& v ){ x=v.x;y=v.y;z=v.z;w=v.w; }				inline void set( const tvec4& v ){ x=v.x;y=v.y;z=v.z;w=v.w; }
-	tvec4( const tvec2<T>& v, T c, T d ){ x=v.x;y=v.y;z=c;w=d; }	inline void set( const tvec2<T>& v, T c, T d ){ x=v.x;y=v.y;z=c;w=d; }
-	tvec4( T a, T b, const tvec2<T>& v ){ x=a;y=b;z=v.x;w=v.y; }	inline void set( T a, T b, const tvec2<T>& v ){ x=a;y=b;z=v.x;w=v.y; }	
-	tvec4( const tvec3<T>& v, T d ){ x=v.x;y=v.y;z=v.z;w=d; }		inline void set( const tvec3<T>& v, T d ){ x=v.x;y=v.y;z=v.z;w=d; }
-	tvec4( T a, const tvec3<T>& v ){ x=a;y=v.x;z=v.y;w=v.z; }		inline void set( T a, const tvec3<T>& v ){ x=a;y=v.x;z=v.y;w=v.z; }
-	tvec4( const tvec2<T>& v1, const tvec2<T>& v2 ){ x=v1.x;y=v1.y;z=v2.x;w=v2.y; }
-	inline void set( const tvec2<T>& v1, const tvec2<T>& v2 ){ x=v1.x;y=v1.y;z=v2.x;w=v2.y; }
+	constexpr tvec4():x(0),y(0),z(0),w(0){}
+	constexpr tvec4( T a ):x(a),y(a),z(a),w(a){}					constexpr void set( T a ){ x=y=z=w=a; }
+	constexpr tvec4( T a, T b, T c, T d ):x(a),y(b),z(c),w(d){}		constexpr void set( T a, T b, T c, T d ){ x=a;y=b;z=c;w=d; }
+	constexpr tvec4( const tvec4& v ) = default;					constexpr void set( const tvec4& v ){ x=v.x;y=v.y;z=v.z;w=v.w; }
+	constexpr tvec4( const tvec2<T>& v, T c, T d ):x(v.x),y(v.y),z(c),w(d){}	constexpr void set( const tvec2<T>& v, T c, T d ){ x=v.x;y=v.y;z=c;w=d; }
+	constexpr tvec4( T a, T b, const tvec2<T>& v ):x(a),y(b),z(v.x),w(v.y){}	constexpr void set( T a, T b, const tvec2<T>& v ){ x=a;y=b;z=v.x;w=v.y; }	
+	constexpr tvec4( const tvec3<T>& v, T d ):x(v.x),y(v.y),z(v.z),w(d){}	constexpr void set( const tvec3<T>& v, T d ){ x=v.x;y=v.y;z=v.z;w=d; }
+	constexpr tvec4( T a, const tvec3<T>& v ):x(a),y(v.x),z(v.y),w(v.z){}	constexpr void set( T a, const tvec3<T>& v ){ x=a;y=v.x;z=v.y;w=v.z; }
+	constexpr tvec4( const tvec2<T>& v1, const tvec2<T>& v2 ):x(v1.x),y(v1.y),z(v2.x),w(v2.y){}
+	constexpr void set( const tvec2<T>& v1, const tvec2<T>& v2 ){ x=v1.x;y=v1.y;z=v2.x;w=v2.y; }
 
 	// assignment / compound assignment operators
-	inline tvec4& operator=( T a ){ set(a); return *this; }
-	inline tvec4& operator+=( const tvec4& v ){ x+=v.x; y+=v.y; z+=v.z; w+=v.w; return *this; }
-	inline tvec4& operator-=( const tvec4& v ){ x-=v.x; y-=v.y; z-=v.z; w-=v.w; return *this; }
-	inline tvec4& operator*=( const tvec4& v ){ x*=v.x; y*=v.y; z*=v.z; w*=v.w; return *this; }
-	inline tvec4& operator/=( const tvec4& v ){ x/=v.x; y/=v.y; z/=v.z; w/=v.w; return *this; }
-	inline tvec4& operator+=( T a ){ x+=a; y+=a; z+=a; w+=a; return *this; }
-	inline tvec4& operator-=( T a ){ x-=a; y-=a; z-=a; w-=a; return *this; }
-	inline tvec4& operator*=( T a ){ x*=a; y*=a; z*=a; w*=a; return *this; }
-	inline tvec4& operator/=( T a ){ x/=a; y/=a; z/=a; w/=a; return *this; }
+	constexpr tvec4& operator=( T a ){ set(a); return *this; }
+	constexpr tvec4& operator+=( const tvec4& v ){ x+=v.x; y+=v.y; z+=v.z; w+=v.w; return *this; }
+	constexpr tvec4& operator-=( const tvec4& v ){ x-=v.x; y-=v.y; z-=v.z; w-=v.w; return *this; }
+	constexpr tvec4& operator*=( const tvec4& v ){ x*=v.x; y*=v.y; z*=v.z; w*=v.w; return *this; }
+	constexpr tvec4& operator/=( const tvec4& v ){ x/=v.x; y/=v.y; z/=v.z; w/=v.w; return *this; }
+	constexpr tvec4& operator+=( T a ){ x+=a; y+=a; z+=a; w+=a; return *this; }
+	constexpr tvec4& operator-=( T a ){ x-=a; y-=a; z-=a; w-=a; return *this; }
+	constexpr tvec4& operator*=( T a ){ x*=a; y*=a; z*=a; w*=a; return *this; }
+	constexpr tvec4& operator/=( T a ){ x/=a; y/=a; z/=a; w/=a; return *this; }
 
 	// comparison operators
 	inline bool operator==( const tvec4& v ) const { return std::abs(x-v.x)<=precision<T>::value()&&std::abs(y-v.y)<=precision<T>::value()&&std::abs(z-v.z)<=precision<T>::value()&&std::abs(w-v.w)<=precision<T>::value(); }
@@ -240,24 +272,24 @@ template <class T> struct tvec4
 	inline const T& at( ptrdiff_t i ) const { return (&r)[i]; }
 
 	// unary operators
-	inline tvec4 operator+() const { return tvec4(r, g, b, a); }
-	inline tvec4 operator-() const { return tvec4(-r, -g, -b, -a); }
+	constexpr tvec4 operator+() const { return tvec4(x, y, z, w); }
+	constexpr tvec4 operator-() const { return tvec4(-x, -y, -z, -w); }
 
 	// binary operators
-	inline tvec4 operator+( const tvec4& v ) const { return tvec4(r+v.r, g+v.g, b+v.b, a+v.a); }
-	inline tvec4 operator-( const tvec4& v ) const { return tvec4(r-v.r, g-v.g, b-v.b, a-v.a); }
-	inline tvec4 operator*( const tvec4& v ) const { return tvec4(r*v.r, g*v.g, b*v.b, a*v.a); }
-	inline tvec4 operator/( const tvec4& v ) const { return tvec4(r/v.r, g/v.g, b/v.b, a/v.a); }
-	inline tvec4 operator+( T v ) const { return tvec4(r+v, g+v, b+v, this->a+v); }
-	inline tvec4 operator-( T v ) const { return tvec4(r-v, g-v, b-v, this->a-v); }
-	inline tvec4 operator*( T v ) const { return tvec4(r*v, g*v, b*v, this->a*v); }
-	inline tvec4 operator/( T v ) const { return tvec4(r/v, g/v, b/v, this->a/v); }
+	constexpr tvec4 operator+( const tvec4& v ) const { return tvec4(x+v.x, y+v.y, z+v.z, w+v.w); }
+	constexpr tvec4 operator-( const tvec4& v ) const { return tvec4(x-v.x, y-v.y, z-v.z, w-v.w); }
+	constexpr tvec4 operator*( const tvec4& v ) const { return tvec4(x*v.x, y*v.y, z*v.z, w*v.w); }
+	constexpr tvec4 operator/( const tvec4& v ) const { return tvec4(x/v.x, y/v.y, z/v.z, w/v.w); }
+	constexpr tvec4 operator+( T v ) const { return tvec4(x+v, y+v, z+v, w+v); }
+	constexpr tvec4 operator-( T v ) const { return tvec4(x-v, y-v, z-v, w-v); }
+	constexpr tvec4 operator*( T v ) const { return tvec4(x*v, y*v, z*v, w*v); }
+	constexpr tvec4 operator/( T v ) const { return tvec4(x/v, y/v, z/v, w/v); }
 
 	// length, normalize, dot product
-	float_memfun(U) inline T length() const { return (T)(sqrt(r*r+g*g+b*b+a*a)); }
-	float_memfun(U) inline tvec4 normalize() const { return tvec4(r, g, b, a)/length(); } 
-	float_memfun(U) inline T dot( const tvec4& v ) const { return (T)(r*v.r+g*v.g+b*v.b+a*v.a); }
-	float_memfun(U) inline T length2() const { return (T)(r*r+g*g+b*b+a*a); }
+	float_memfun(U) inline T length() const { return (T)(sqrt(x*x+y*y+z*z+w*w)); }
+	float_memfun(U) inline tvec4 normalize() const { return tvec4(x, y, z, w)/length(); } 
+	float_memfun(U) constexpr T dot( const tvec4& v ) const { return (T)(x*v.x+y*v.y+z*v.z+w*v.w); }
+	float_memfun(U) constexpr T length2() const { return (T)(x*x+y*y+z*z+w*w); }
 };
 
 //*******************************************************************
@@ -273,8 +305,8 @@ struct mat3
 {
 	union { float a[9]; struct {float _11,_12,_13,_21,_22,_23,_31,_32,_33;}; };
 
-	inline mat3(){ _12=_13=_21=_23=_31=_32=0.0f;_11=_22=_33=1.0f; }
-	inline mat3( float f11, float f12, float f13, float f21, float f22, float f23, float f31, float f32, float f33 ){_11=f11;_12=f12;_13=f13;_21=f21;_22=f22;_23=f23;_31=f31;_32=f32;_33=f33;}
+	constexpr mat3():a{1,0,0,0,1,0,0,0,1}{}
+	constexpr mat3( float f11, float f12, float f13, float f21, float f22, float f23, float f31, float f32, float f33 ):a{f11,f12,f13,f21,f22,f23,f31,f32,f33}{}
 
 	// comparison operators
 	inline bool operator==( const mat3& m ) const {
@@ -288,34 +320,34 @@ struct mat3
 	inline operator const float*() const { return a; }
 
 	// array access operators
-	inline float& operator[]( ptrdiff_t i ){ return a[i]; }
-	inline const float& operator[]( ptrdiff_t i ) const { return a[i]; }
-	inline float& at( ptrdiff_t i ){ return a[i]; }
-	inline const float& at( ptrdiff_t i ) const { return a[i]; }
+	constexpr float& operator[]( ptrdiff_t i ){ return a[i]; }
+	constexpr const float& operator[]( ptrdiff_t i ) const { return a[i]; }
+	constexpr float& at( ptrdiff_t i ){ return a[i]; }
+	constexpr const float& at( ptrdiff_t i ) const { return a[i]; }
 
 	// row vectors
 	inline vec3& rvec3( int row ){ return reinterpret_cast<vec3&>(a[row*3]); }
 	inline const vec3& rvec3( int row ) const { return reinterpret_cast<const vec3&>(a[row*3]); }
 
 	// identity and transpose
-	inline static mat3 identity(){ return mat3(); }
-	inline mat3& set_identity(){ _12=_13=_21=_23=_31=_32=0.0f;_11=_22=_33=1.0f; return *this; }
-	inline mat3 transpose() const { return mat3(_11,_21,_31,_12,_22,_32,_13,_23,_33); }
+	constexpr static mat3 identity(){ return mat3(); }
+	constexpr mat3& set_identity(){ return *this=mat3(); }
+	constexpr mat3 transpose() const { return mat3(a[0],a[3],a[6],a[1],a[4],a[7],a[2],a[5],a[8]); }
 
 	// addition/subtraction operators
-	inline mat3 operator+( const mat3& m ) const { mat3 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]+m[k]; return r; }
-	inline mat3 operator-( const mat3& m ) const { mat3 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]-m[k]; return r; }
-	inline mat3& operator+=( const mat3& m ){ return *this=operator+(m); }
-	inline mat3& operator-=( const mat3& m ){ return *this=operator-(m); }
+	constexpr mat3 operator+( const mat3& m ) const { mat3 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]+m[k]; return r; }
+	constexpr mat3 operator-( const mat3& m ) const { mat3 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]-m[k]; return r; }
+	constexpr mat3& operator+=( const mat3& m ){ return *this=operator+(m); }
+	constexpr mat3& operator-=( const mat3& m ){ return *this=operator-(m); }
 
 	// multiplication operators
-	inline mat3 operator*( float f ) const { mat3 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]*f; return r; }
-	inline vec3 operator*( const vec3& v ) const { return vec3(rvec3(0).dot(v), rvec3(1).dot(v), rvec3(2).dot(v)); }
-	inline mat3 operator*( const mat3& m ) const { mat3 t=m.transpose(), r; for(int k=0;k<3;k++) r.rvec3(k)=t.operator*(rvec3(k)); return r; } // a bit tricky implementation
-	inline mat3& operator*=( const mat3& m ){ return *this=operator*(m); }
+	constexpr mat3 operator*( float f ) const { mat3 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]*f; return r; }
+	constexpr vec3 operator*( const vec3& v ) const { return vec3(a[0]*v.x+a[1]*v.y+a[2]*v.z, a[3]*v.x+a[4]*v.y+a[5]*v.z, a[6]*v.x+a[7]*v.y+a[8]*v.z); }
+	constexpr mat3 operator*( const mat3& m ) const { mat3 r; for( int k=0; k < 9; k+=3 ) for( int j=0; j < 3; j++ ) r.a[k+j] = a[k]*m.a[j]+a[k+1]*m.a[3+j]+a[k+2]*m.a[6+j]; return r; }
+	constexpr mat3& operator*=( const mat3& m ){ return *this=operator*(m); }
 
 	// determinant
-	inline float det() const { return _11*(_22*_33-_23*_32) + _12*(_23*_31-_21*_33) + _13*(_21*_32-_22*_31); }
+	constexpr float det() const { return a[0]*(a[4]*a[8]-a[5]*a[7]) + a[1]*(a[5]*a[6]-a[3]*a[8]) + a[2]*(a[3]*a[7]-a[4]*a[6]); }
 
 	// inverse
 	inline mat3 inverse() const
@@ -327,12 +359,12 @@ struct mat3
 
 //*******************************************************************
 // matrix 4x4: uses a standard row-major notation
-struct mat4
+struct CGMATH_ALIGN mat4
 {
 	union { float a[16]; struct {float _11,_12,_13,_14,_21,_22,_23,_24,_31,_32,_33,_34,_41,_42,_43,_44;}; };
 
-	mat4(){ _12=_13=_14=_21=_23=_24=_31=_32=_34=_41=_42=_43=0.0f;_11=_22=_33=_44=1.0f; }
-	mat4( float f11, float f12, float f13, float f14, float f21, float f22, float f23, float f24, float f31, float f32, float f33, float f34, float f41, float f42, float f43, float f44 ){_11=f11;_12=f12;_13=f13;_14=f14;_21=f21;_22=f22;_23=f23;_24=f24;_31=f31;_32=f32;_33=f33;_34=f34;_41=f41;_42=f42;_43=f43;_44=f44;}
+	constexpr mat4():a{1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1}{}
+	constexpr mat4( float f11, float f12, float f13, float f14, float f21, float f22, float f23, float f24, float f31, float f32, float f33, float f34, float f41, float f42, float f43, float f44 ):a{f11,f12,f13,f14,f21,f22,f23,f24,f31,f32,f33,f34,f41,f42,f43,f44}{}
 
 	// comparison operators
 	inline bool operator==( const mat4& m ) const { for( size_t k=0; k<std::extent<decltype(a)>::value; k++ ) if(std::abs(a[k]-m[k])>precision<float>::value()) return false; return true; }
@@ -341,13 +373,13 @@ struct mat4
 	// casting operators
 	inline operator float*(){ return a; }
 	inline operator const float*() const { return a; }
-	inline operator mat3() const {return mat3(_11, _12, _13, _21, _22, _23, _31, _32, _33 ); }
+	constexpr operator mat3() const {return mat3(a[0], a[1], a[2], a[4], a[5], a[6], a[8], a[9], a[10] ); }
 
 	// array access operators
-	inline float& operator[]( ptrdiff_t i ){ return a[i]; }
-	inline const float& operator[]( ptrdiff_t i ) const { return a[i]; }
-	inline float& at( ptrdiff_t i ){ return a[i]; }
-	inline const float& at( ptrdiff_t i ) const { return a[i]; }
+	constexpr float& operator[]( ptrdiff_t i ){ return a[i]; }
+	constexpr const float& operator[]( ptrdiff_t i ) const { return a[i]; }
+	constexpr float& at( ptrdiff_t i ){ return a[i]; }
+	constexpr const float& at( ptrdiff_t i ) const { return a[i]; }
 
 	// row vectors
 	inline vec4& rvec4( int row ){ return reinterpret_cast<vec4&>(a[row*4]); }
@@ -356,40 +388,42 @@ struct mat4
 	inline const vec3& rvec3( int row ) const { return reinterpret_cast<const vec3&>(a[row*4]); }
 
 	// identity and transpose
-	static mat4 identity(){ return mat4(); }
-	inline mat4& set_identity(){ _12=_13=_14=_21=_23=_24=_31=_32=_34=_41=_42=_43=0.0f;_11=_22=_33=_44=1.0f; return *this; }
-	inline mat4 transpose() const { return mat4(_11, _21, _31, _41, _12, _22, _32, _42, _13, _23, _33, _43, _14, _24, _34, _44); }
+	constexpr static mat4 identity(){ return mat4(); }
+	constexpr mat4& set_identity(){ return *this=mat4(); }
+	constexpr mat4 transpose() const { return mat4(a[0], a[4], a[8], a[12], a[1], a[5], a[9], a[13], a[2], a[6], a[10], a[14], a[3], a[7], a[11], a[15]); }
 
 	// addition/subtraction operators
-	inline mat4 operator+( const mat4& m ) const { mat4 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]+m[k]; return r; }
-	inline mat4 operator-( const mat4& m ) const { mat4 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]-m[k]; return r; }
-	inline mat4& operator+=( const mat4& m ){ return *this=operator+(m); }
-	inline mat4& operator-=( const mat4& m ){ return *this=operator-(m); }
+	constexpr mat4 operator+( const mat4& m ) const { mat4 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]+m[k]; return r; }
+	constexpr mat4 operator-( const mat4& m ) const { mat4 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]-m[k]; return r; }
+	constexpr mat4& operator+=( const mat4& m ){ return *this=operator+(m); }
+	constexpr mat4& operator-=( const mat4& m ){ return *this=operator-(m); }
 
 	// multiplication operators
-	inline mat4 operator*( float f ) const { mat4 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]*f; return r; }
-	inline vec4 operator*( const vec4& v ) const { return vec4(rvec4(0).dot(v), rvec4(1).dot(v), rvec4(2).dot(v), rvec4(3).dot(v)); }
-	inline mat4 operator*( const mat4& m ) const { mat4 t=m.transpose(), r; for(int k=0;k<4;k++) r.rvec4(k)=t.operator*(rvec4(k)); return r; } // a bit tricky implementation
-	inline mat4& operator*=( const mat4& m ){ return *this=operator*(m); }
+	constexpr mat4 operator*( float f ) const { mat4 r; for( size_t k=0; k < std::extent<decltype(a)>::value; k++ ) r[k]=a[k]*f; return r; }
+	constexpr vec4 operator*( const vec4& v ) const;	// SIMD or scalar: see below for implementations
+	constexpr mat4 operator*( const mat4& m ) const;
+	constexpr mat4& operator*=( const mat4& m ){ return *this=operator*(m); }
 
 	// determinant and inverse: see below for implementations
 	inline float det() const;
-	inline mat4 inverse() const;
+	inline mat4 inverse() const;			// general inverse; singular matrices yield non-finite elements, so test det() beforehand if needed
+	inline mat4 inverse_affine() const;		// assumes the last row of (0,0,0,1): e.g., translate*rotate*scale; singular matrices yield zeros
+	inline mat4 inverse_rigid() const;		// assumes rotation and translation only: e.g., look_at
 
 	// static row-major transformations
-	static mat4 translate( const vec3& v ){ return mat4().set_translate(v); }
-	static mat4 translate( float x, float y, float z ){ return mat4().set_translate(x,y,z); }
-	static mat4 scale( const vec3& v ){ return mat4().set_scale(v); }
-	static mat4 scale( float x, float y, float z ){ return mat4().set_scale(x,y,z); }
+	constexpr static mat4 translate( const vec3& v ){ return mat4().set_translate(v); }
+	constexpr static mat4 translate( float x, float y, float z ){ return mat4().set_translate(x,y,z); }
+	constexpr static mat4 scale( const vec3& v ){ return mat4().set_scale(v); }
+	constexpr static mat4 scale( float x, float y, float z ){ return mat4().set_scale(x,y,z); }
 	static mat4 rotate( const vec3& axis, float angle ){ return mat4().set_rotate(axis,angle); }
 	static mat4 look_at( const vec3& eye, const vec3& at, const vec3& up ){ return mat4().set_look_at(eye, at, up); }
 	static mat4 perspective( float fovy, float aspect, float dnear, float dfar ){ return mat4().set_perspective(fovy, aspect, dnear, dfar); }
 
 	// row-major transformations
-	inline mat4& set_translate( const vec3& v ){ set_identity(); _14=v.x; _24=v.y; _34=v.z; return *this; }
-	inline mat4& set_translate( float x,float y,float z ){ set_identity(); _14=x; _24=y; _34=z; return *this; }
-	inline mat4& set_scale( const vec3& v ){ set_identity(); _11=v.x; _22=v.y; _33=v.z; return *this; }
-	inline mat4& set_scale( float x, float y, float z ){ set_identity(); _11=x; _22=y; _33=z; return *this; }
+	constexpr mat4& set_translate( const vec3& v ){ set_identity(); a[3]=v.x; a[7]=v.y; a[11]=v.z; return *this; }
+	constexpr mat4& set_translate( float x,float y,float z ){ set_identity(); a[3]=x; a[7]=y; a[11]=z; return *this; }
+	constexpr mat4& set_scale( const vec3& v ){ set_identity(); a[0]=v.x; a[5]=v.y; a[10]=v.z; return *this; }
+	constexpr mat4& set_scale( float x, float y, float z ){ set_identity(); a[0]=x; a[5]=y; a[10]=z; return *this; }
 	inline mat4& set_rotate( const vec3& axis, float angle )
 	{
 		float c=cos(angle), s=sin(angle), x=axis.x, y=axis.y, z=axis.z;
@@ -431,6 +465,60 @@ struct mat4
 	}
 };
 
+// SIMD products: not constexpr, so that the operators below call them only at run time
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)||defined(CGMATH_NEON)
+// products in the same order of additions as the scalar dot products; thus, SSE/AVX results are identical to scalar ones
+inline vec4 _cgmath_simd_mul( const mat4& m, const vec4& v )
+{
+	const float* a=m.a;
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)
+	__m128 w=_mm_loadu_ps(&v.x), r0=_mm_mul_ps(_cgmath_load_ps(a),w), r1=_mm_mul_ps(_cgmath_load_ps(a+4),w), r2=_mm_mul_ps(_cgmath_load_ps(a+8),w), r3=_mm_mul_ps(_cgmath_load_ps(a+12),w);
+	_MM_TRANSPOSE4_PS( r0, r1, r2, r3 ); // r[k] = k-th products of the four rows
+	vec4 r; _mm_storeu_ps( &r.x, _mm_add_ps(_mm_add_ps(_mm_add_ps(r0,r1),r2),r3) ); return r;
+#else
+	float32x4_t w=vld1q_f32(&v.x);
+	return vec4( vaddvq_f32(vmulq_f32(vld1q_f32(a),w)), vaddvq_f32(vmulq_f32(vld1q_f32(a+4),w)), vaddvq_f32(vmulq_f32(vld1q_f32(a+8),w)), vaddvq_f32(vmulq_f32(vld1q_f32(a+12),w)) );
+#endif
+}
+
+// each row of the result is a linear combination of the rows of m; unrolled to keep rows in registers
+// on x86, rows of m are gathered from scalars, which avoids store-forwarding stalls on freshly built matrices (e.g., translate()*rotate())
+inline mat4 _cgmath_simd_mul( const mat4& l, const mat4& m )
+{
+	const float* a=l.a; mat4 r;
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE) // 256-bit lanes need extra shuffles for 4x4 products; AVX uses VEX-encoded 128-bit ops
+	__m128 b0=_mm_setr_ps(m.a[0],m.a[1],m.a[2],m.a[3]), b1=_mm_setr_ps(m.a[4],m.a[5],m.a[6],m.a[7]), b2=_mm_setr_ps(m.a[8],m.a[9],m.a[10],m.a[11]), b3=_mm_setr_ps(m.a[12],m.a[13],m.a[14],m.a[15]);
+	auto row = [&]( const float* l ){ return _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(l[0]),b0),_mm_mul_ps(_mm_set1_ps(l[1]),b1)),_mm_mul_ps(_mm_set1_ps(l[2]),b2)),_mm_mul_ps(_mm_set1_ps(l[3]),b3)); };
+	__m128 r0=row(a), r1=row(a+4), r2=row(a+8), r3=row(a+12);
+	_cgmath_store_ps( r.a, r0 ); _cgmath_store_ps( r.a+4, r1 ); _cgmath_store_ps( r.a+8, r2 ); _cgmath_store_ps( r.a+12, r3 );
+#else
+	float32x4_t b0=vld1q_f32(m.a), b1=vld1q_f32(m.a+4), b2=vld1q_f32(m.a+8), b3=vld1q_f32(m.a+12);
+	auto row = [&]( const float* l ){ return vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(b0,l[0]),b1,l[1]),b2,l[2]),b3,l[3]); };
+	float32x4_t r0=row(a), r1=row(a+4), r2=row(a+8), r3=row(a+12);
+	vst1q_f32( r.a, r0 ); vst1q_f32( r.a+4, r1 ); vst1q_f32( r.a+8, r2 ); vst1q_f32( r.a+12, r3 );
+#endif
+	return r;
+}
+#endif
+
+constexpr vec4 mat4::operator*( const vec4& v ) const
+{
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)||defined(CGMATH_NEON)
+	if(!_cgmath_constant_evaluated()) return _cgmath_simd_mul( *this, v );
+#endif
+	return vec4( a[0]*v.x+a[1]*v.y+a[2]*v.z+a[3]*v.w, a[4]*v.x+a[5]*v.y+a[6]*v.z+a[7]*v.w, a[8]*v.x+a[9]*v.y+a[10]*v.z+a[11]*v.w, a[12]*v.x+a[13]*v.y+a[14]*v.z+a[15]*v.w );
+}
+
+constexpr mat4 mat4::operator*( const mat4& m ) const
+{
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)||defined(CGMATH_NEON)
+	if(!_cgmath_constant_evaluated()) return _cgmath_simd_mul( *this, m );
+#endif
+	mat4 r;
+	for( int k=0; k < 16; k+=4 ) for( int j=0; j < 4; j++ ) r.a[k+j] = a[k]*m.a[j]+a[k+1]*m.a[4+j]+a[k+2]*m.a[8+j]+a[k+3]*m.a[12+j];
+	return r;
+}
+
 inline float mat4::det() const
 {
 	return
@@ -442,9 +530,35 @@ inline float mat4::det() const
 	_31 * _12 * _23 * _44 - _11 * _32 * _23 * _44 - _21 * _12 * _33 * _44 + _11 * _22 * _33 * _44 ;
 }
 
+// SSE: block-wise inversion with 2x2 sub-matrices, M = [A B; C D], and the adjugates (#) of them
+// NEON uses the scalar cofactor expansion
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)
+#define _cgmath_swizzle(v,x,y,z,w) _mm_shuffle_ps(v,v,_MM_SHUFFLE(w,z,y,x))
+inline __m128 _cgmath_mat2_mul( __m128 a, __m128 b ){ return _mm_add_ps(_mm_mul_ps(a,_cgmath_swizzle(b,0,3,0,3)),_mm_mul_ps(_cgmath_swizzle(a,1,0,3,2),_cgmath_swizzle(b,2,1,2,1))); }		// A*B
+inline __m128 _cgmath_mat2_adj_mul( __m128 a, __m128 b ){ return _mm_sub_ps(_mm_mul_ps(_cgmath_swizzle(a,3,3,0,0),b),_mm_mul_ps(_cgmath_swizzle(a,1,1,2,2),_cgmath_swizzle(b,2,3,0,1))); }	// A#*B
+inline __m128 _cgmath_mat2_mul_adj( __m128 a, __m128 b ){ return _mm_sub_ps(_mm_mul_ps(a,_cgmath_swizzle(b,3,0,3,0)),_mm_mul_ps(_cgmath_swizzle(a,1,0,3,2),_cgmath_swizzle(b,2,1,2,1))); }	// A*B#
+#endif
+
 inline mat4 mat4::inverse() const
 {
-	float d=det(), s=1.0f/d; if(d==0) printf( "mat4::inverse() might be singular.\n" );
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)
+	__m128 r0=_cgmath_load_ps(a), r1=_cgmath_load_ps(a+4), r2=_cgmath_load_ps(a+8), r3=_cgmath_load_ps(a+12);
+	__m128 A=_mm_movelh_ps(r0,r1), B=_mm_movehl_ps(r1,r0), C=_mm_movelh_ps(r2,r3), D=_mm_movehl_ps(r3,r2); // 2x2 blocks in row-major order
+	__m128 ds = _mm_sub_ps( _mm_mul_ps(_mm_shuffle_ps(r0,r2,_MM_SHUFFLE(2,0,2,0)),_mm_shuffle_ps(r1,r3,_MM_SHUFFLE(3,1,3,1))), _mm_mul_ps(_mm_shuffle_ps(r0,r2,_MM_SHUFFLE(3,1,3,1)),_mm_shuffle_ps(r1,r3,_MM_SHUFFLE(2,0,2,0))) );
+	__m128 dA=_cgmath_swizzle(ds,0,0,0,0), dB=_cgmath_swizzle(ds,1,1,1,1), dC=_cgmath_swizzle(ds,2,2,2,2), dD=_cgmath_swizzle(ds,3,3,3,3); // |A| |B| |C| |D|
+	__m128 D_C=_cgmath_mat2_adj_mul(D,C), A_B=_cgmath_mat2_adj_mul(A,B);
+	__m128 X=_mm_sub_ps(_mm_mul_ps(dD,A),_cgmath_mat2_mul(B,D_C)), W=_mm_sub_ps(_mm_mul_ps(dA,D),_cgmath_mat2_mul(C,A_B));
+	__m128 Y=_mm_sub_ps(_mm_mul_ps(dB,C),_cgmath_mat2_mul_adj(D,A_B)), Z=_mm_sub_ps(_mm_mul_ps(dC,B),_cgmath_mat2_mul_adj(A,D_C));
+	__m128 tr=_mm_mul_ps(A_B,_cgmath_swizzle(D_C,0,2,1,3)); tr=_mm_add_ps(tr,_cgmath_swizzle(tr,1,0,3,2)); tr=_mm_add_ps(tr,_cgmath_swizzle(tr,2,3,0,1));
+	__m128 d=_mm_sub_ps(_mm_add_ps(_mm_mul_ps(dA,dD),_mm_mul_ps(dB,dC)),tr); // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+	__m128 s=_mm_div_ps(_mm_setr_ps(1.0f,-1.0f,-1.0f,1.0f),d);
+	X=_mm_mul_ps(X,s); Y=_mm_mul_ps(Y,s); Z=_mm_mul_ps(Z,s); W=_mm_mul_ps(W,s);
+	mat4 r; // adjugates of the blocks are shuffled into the rows
+	_cgmath_store_ps( r.a, _mm_shuffle_ps(X,Y,_MM_SHUFFLE(1,3,1,3)) ); _cgmath_store_ps( r.a+4, _mm_shuffle_ps(X,Y,_MM_SHUFFLE(0,2,0,2)) );
+	_cgmath_store_ps( r.a+8, _mm_shuffle_ps(Z,W,_MM_SHUFFLE(1,3,1,3)) ); _cgmath_store_ps( r.a+12, _mm_shuffle_ps(Z,W,_MM_SHUFFLE(0,2,0,2)) );
+	return r;
+#else
+	float s=1.0f/det();
 	return mat4((_32*_43*_24 - _42*_33*_24 + _42*_23*_34 - _22*_43*_34 - _32*_23*_44 + _22*_33*_44)*s,
 				(_42*_33*_14 - _32*_43*_14 - _42*_13*_34 + _12*_43*_34 + _32*_13*_44 - _12*_33*_44)*s,
 				(_22*_43*_14 - _42*_23*_14 + _42*_13*_24 - _12*_43*_24 - _22*_13*_44 + _12*_23*_44)*s,
@@ -464,34 +578,344 @@ inline mat4 mat4::inverse() const
 				(_31*_42*_13 - _41*_32*_13 + _41*_12*_33 - _11*_42*_33 - _31*_12*_43 + _11*_32*_43)*s,
 				(_41*_22*_13 - _21*_42*_13 - _41*_12*_23 + _11*_42*_23 + _21*_12*_43 - _11*_22*_43)*s,
 				(_21*_32*_13 - _31*_22*_13 + _31*_12*_23 - _11*_32*_23 - _21*_12*_33 + _11*_22*_33)*s );
+#endif
+}
+
+inline mat4 mat4::inverse_affine() const
+{
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)
+	// columns of the 3x3 inverse are cross products of the rows, and the translation is their combination by the old one;
+	// a single transpose places them into rows with the translation in w
+	__m128 r0=_cgmath_load_ps(a), r1=_cgmath_load_ps(a+4), r2=_cgmath_load_ps(a+8);
+	auto cross = []( __m128 u, __m128 v ){ return _mm_sub_ps(_mm_mul_ps(_cgmath_swizzle(u,1,2,0,3),_cgmath_swizzle(v,2,0,1,3)),_mm_mul_ps(_cgmath_swizzle(u,2,0,1,3),_cgmath_swizzle(v,1,2,0,3))); };
+	__m128 x0=cross(r1,r2), x1=cross(r2,r0), x2=cross(r0,r1), d=_mm_mul_ps(r0,x0);
+	d = _mm_add_ss( _mm_add_ss(d,_cgmath_swizzle(d,1,1,1,1)), _cgmath_swizzle(d,2,2,2,2) ); if(_mm_cvtss_f32(d)==0) return mat4()*0.0f;
+	__m128 s=_mm_div_ps(_mm_set1_ps(1.0f),_cgmath_swizzle(d,0,0,0,0)); x0=_mm_mul_ps(x0,s); x1=_mm_mul_ps(x1,s); x2=_mm_mul_ps(x2,s);
+	__m128 t=_mm_sub_ps(_mm_setzero_ps(),_mm_add_ps(_mm_add_ps(_mm_mul_ps(x0,_cgmath_swizzle(r0,3,3,3,3)),_mm_mul_ps(x1,_cgmath_swizzle(r1,3,3,3,3))),_mm_mul_ps(x2,_cgmath_swizzle(r2,3,3,3,3))));
+	_MM_TRANSPOSE4_PS( x0, x1, x2, t );
+	mat4 r; _cgmath_store_ps( r.a, x0 ); _cgmath_store_ps( r.a+4, x1 ); _cgmath_store_ps( r.a+8, x2 ); _cgmath_store_ps( r.a+12, _mm_setr_ps(0,0,0,1.0f) );
+	return r;
+#else
+	// inverse of the 3x3 block: transposed cofactors divided by the determinant
+	float c11=_22*_33-_23*_32, c12=_23*_31-_21*_33, c13=_21*_32-_22*_31;
+	float c21=_13*_32-_12*_33, c22=_11*_33-_13*_31, c23=_12*_31-_11*_32;
+	float c31=_12*_23-_13*_22, c32=_13*_21-_11*_23, c33=_11*_22-_12*_21;
+	float d=_11*c11+_12*c12+_13*c13; if(d==0) return mat4()*0.0f;
+	float s=1.0f/d;
+	mat4 r( c11*s, c21*s, c31*s, 0, c12*s, c22*s, c32*s, 0, c13*s, c23*s, c33*s, 0, 0, 0, 0, 1 );
+	r._14 = -(r._11*_14+r._12*_24+r._13*_34); r._24 = -(r._21*_14+r._22*_24+r._23*_34); r._34 = -(r._31*_14+r._32*_24+r._33*_34);
+	return r;
+#endif
+}
+
+inline mat4 mat4::inverse_rigid() const
+{
+	// transposed rotation and the negated translation rotated by it
+	return mat4( _11, _21, _31, -(_11*_14+_21*_24+_31*_34),
+				 _12, _22, _32, -(_12*_14+_22*_24+_32*_34),
+				 _13, _23, _33, -(_13*_14+_23*_24+_33*_34),
+				 0, 0, 0, 1 );
+}
+
+//*******************************************************************
+// quaternion for rotations: (x,y,z) = axis*sin(angle/2) and w = cos(angle/2)
+// q1*q2 applies q2 first as in matrix products; rotations assume unit quaternions
+struct quat
+{
+	float x, y, z, w;
+
+	// constructor/set
+	constexpr quat():x(0),y(0),z(0),w(1){}
+	constexpr quat( float a, float b, float c, float d ):x(a),y(b),z(c),w(d){}
+	constexpr quat( const vec3& v, float d ):x(v.x),y(v.y),z(v.z),w(d){}
+	explicit quat( const mat3& m );	// from a rotation matrix
+
+	// static rotations: the same as mat4::rotate() for a unit axis
+	static quat rotate( const vec3& axis, float angle ){ float s=sin(angle*0.5f); return quat( axis.x*s, axis.y*s, axis.z*s, cos(angle*0.5f) ); }
+
+	// array access operators
+	inline float& operator[]( ptrdiff_t i ){ return (&x)[i]; }
+	inline const float& operator[]( ptrdiff_t i ) const { return (&x)[i]; }
+	constexpr vec3 xyz() const { return vec3(x,y,z); }
+
+	// arithmetic operators: Hamilton product for composition, and component-wise ones for interpolation
+	constexpr quat operator*( const quat& q ) const { return quat( w*q.x+x*q.w+y*q.z-z*q.y, w*q.y-x*q.z+y*q.w+z*q.x, w*q.z+x*q.y-y*q.x+z*q.w, w*q.w-x*q.x-y*q.y-z*q.z ); }
+	constexpr quat& operator*=( const quat& q ){ return *this=operator*(q); }
+	constexpr quat operator*( float f ) const { return quat( x*f, y*f, z*f, w*f ); }
+	constexpr quat operator+( const quat& q ) const { return quat( x+q.x, y+q.y, z+q.z, w+q.w ); }
+	constexpr quat operator-( const quat& q ) const { return quat( x-q.x, y-q.y, z-q.z, w-q.w ); }
+	constexpr quat operator-() const { return quat( -x, -y, -z, -w ); }
+
+	// rotation of a vector without building a matrix: v + w*t + cross(q.xyz,t) with t = 2*cross(q.xyz,v)
+	constexpr vec3 operator*( const vec3& v ) const { vec3 u(x,y,z), t=u.cross(v)*2.0f; return v+t*w+u.cross(t); }
+
+	// length, normalize, dot product, conjugate, and inverse
+	constexpr float dot( const quat& q ) const { return x*q.x+y*q.y+z*q.z+w*q.w; }
+	inline float length() const { return sqrtf(dot(*this)); }
+	inline quat normalize() const { return operator*(1.0f/length()); }
+	constexpr quat conjugate() const { return quat( -x, -y, -z, w ); }
+	inline quat inverse() const { return conjugate()*(1.0f/dot(*this)); }
+
+	// conversion to row-major rotation matrices
+	constexpr mat3 to_mat3() const
+	{
+		float xx=x*x, yy=y*y, zz=z*z, xy=x*y, xz=x*z, yz=y*z, wx=w*x, wy=w*y, wz=w*z;
+		return mat3( 1-2*(yy+zz), 2*(xy-wz), 2*(xz+wy),
+					 2*(xy+wz), 1-2*(xx+zz), 2*(yz-wx),
+					 2*(xz-wy), 2*(yz+wx), 1-2*(xx+yy) );
+	}
+	constexpr mat4 to_mat4() const { mat3 m=to_mat3(); return mat4( m.a[0], m.a[1], m.a[2], 0, m.a[3], m.a[4], m.a[5], 0, m.a[6], m.a[7], m.a[8], 0, 0, 0, 0, 1 ); }
+};
+
+inline quat::quat( const mat3& m )
+{
+	// branch on the largest of w, x, y, z for numerical stability
+	float t = m._11+m._22+m._33;
+	if(t>0){				float s=sqrtf(t+1.0f)*2.0f;				w=0.25f*s; x=(m._32-m._23)/s; y=(m._13-m._31)/s; z=(m._21-m._12)/s; }
+	else if(m._11>m._22&&m._11>m._33){	float s=sqrtf(1.0f+m._11-m._22-m._33)*2.0f;	w=(m._32-m._23)/s; x=0.25f*s; y=(m._12+m._21)/s; z=(m._13+m._31)/s; }
+	else if(m._22>m._33){	float s=sqrtf(1.0f+m._22-m._11-m._33)*2.0f;	w=(m._13-m._31)/s; x=(m._12+m._21)/s; y=0.25f*s; z=(m._23+m._32)/s; }
+	else {					float s=sqrtf(1.0f+m._33-m._11-m._22)*2.0f;	w=(m._21-m._12)/s; x=(m._13+m._31)/s; y=(m._23+m._32)/s; z=0.25f*s; }
+}
+
+constexpr float dot( const quat& q1, const quat& q2 ){ return q1.dot(q2); }
+inline quat normalize( const quat& q ){ return q.normalize(); }
+
+// interpolations along the shorter arc: nlerp is cheaper but not constant-speed
+inline quat nlerp( const quat& q1, const quat& q2, float t ){ return (q1*(1.0f-t)+(q1.dot(q2)<0?-q2:q2)*t).normalize(); }
+inline quat slerp( const quat& q1, const quat& q2, float t )
+{
+	float d=q1.dot(q2); quat q=d<0?-q2:q2; d=fabs(d);
+	if(d>0.9995f) return nlerp(q1,q,t); // nearly parallel: sin(theta) vanishes
+	float theta=acos(d), s=1.0f/sin(theta);
+	return q1*(sin((1.0f-t)*theta)*s)+q*(sin(t*theta)*s);
 }
 
+//*******************************************************************
+// dual quaternion for rigid transformations: real part for the rotation, and dual = 0.5*(t,0)*real for translation t
+// composition is the same order as matrices: (a*b)*p = a*(b*p)
+struct dquat
+{
+	quat real, dual;
+
+	// constructor/set
+	constexpr dquat():dual(0,0,0,0){}
+	constexpr dquat( const quat& r, const quat& d ):real(r),dual(d){}
+	constexpr explicit dquat( const quat& r, const vec3& t=vec3(0) ):real(r),dual(quat(t,0)*r*0.5f){} // rotation followed by translation
+
+	// static rigid transformations
+	constexpr static dquat translate( const vec3& t ){ return dquat(quat(),quat(t*0.5f,0)); }
+	constexpr static dquat translate( float x, float y, float z ){ return dquat(quat(),quat(x*0.5f,y*0.5f,z*0.5f,0)); }
+	static dquat rotate( const vec3& axis, float angle ){ return dquat(quat::rotate(axis,angle)); }
+
+	// composition, blending, and transformations of points
+	constexpr dquat operator*( const dquat& q ) const { return dquat( real*q.real, real*q.dual+dual*q.real ); }
+	constexpr dquat& operator*=( const dquat& q ){ return *this=operator*(q); }
+	constexpr dquat operator*( float f ) const { return dquat( real*f, dual*f ); }
+	constexpr dquat operator+( const dquat& q ) const { return dquat( real+q.real, dual+q.dual ); }
+	constexpr vec3 operator*( const vec3& p ) const { return real*p+translation(); }
+
+	// translation, normalization, and inverse of unit dual quaternions
+	constexpr vec3 translation() const { return (dual*real.conjugate()).xyz()*2.0f; }
+	inline dquat normalize() const { float s=1.0f/real.length(); quat r=real*s, d=dual*s; return dquat( r, d-r*r.dot(d) ); }
+	constexpr dquat inverse() const { return dquat( real.conjugate(), dual.conjugate() ); }
+
+	// conversion to a row-major matrix
+	constexpr mat4 to_mat4() const { mat4 m=real.to_mat4(); vec3 t=translation(); m.a[3]=t.x; m.a[7]=t.y; m.a[11]=t.z; return m; }
+};
+
+// dual-quaternion linear blending (e.g., for skinning): weights of q2 flipped to the hemisphere of q1
+inline dquat nlerp( const dquat& q1, const dquat& q2, float t ){ return (q1*(1.0f-t)+q2*(q1.real.dot(q2.real)<0?-t:t)).normalize(); }
+
 //*******************************************************************
 // scalar-vector operators
-inline vec2 operator+( float f, const vec2& v ){ return v+f; }
-inline vec3 operator+( float f, const vec3& v ){ return v+f; }
-inline vec4 operator+( float f, const vec4& v ){ return v+f; }
-inline vec2 operator-( float f, const vec2& v ){ return -v+f; }
-inline vec3 operator-( float f, const vec3& v ){ return -v+f; }
-inline vec4 operator-( float f, const vec4& v ){ return -v+f; }
-inline vec2 operator*( float f, const vec2& v ){ return v*f; }
-inline vec3 operator*( float f, const vec3& v ){ return v*f; }
-inline vec4 operator*( float f, const vec4& v ){ return v*f; }
+constexpr vec2 operator+( float f, const vec2& v ){ return v+f; }
+constexpr vec3 operator+( float f, const vec3& v ){ return v+f; }
+constexpr vec4 operator+( float f, const vec4& v ){ return v+f; }
+constexpr vec2 operator-( float f, const vec2& v ){ return -v+f; }
+constexpr vec3 operator-( float f, const vec3& v ){ return -v+f; }
+constexpr vec4 operator-( float f, const vec4& v ){ return -v+f; }
+constexpr vec2 operator*( float f, const vec2& v ){ return v*f; }
+constexpr vec3 operator*( float f, const vec3& v ){ return v*f; }
+constexpr vec4 operator*( float f, const vec4& v ){ return v*f; }
 
 //*******************************************************************
 // vertor-matrix multiplications
-inline vec3 mul( const vec3& v, const mat3& m ){ return m.transpose()*v; }
-inline vec4 mul( const vec4& v, const mat4& m ){ return m.transpose()*v; }
-inline vec3 mul( const mat3& m, const vec3& v ){ return m*v; }
-inline vec4 mul( const mat4& m, const vec4& v ){ return m*v; }
-inline vec3 operator*( const vec3& v, const mat3& m ){ return m.transpose()*v; }
-inline vec4 operator*( const vec4& v, const mat4& m ){ return m.transpose()*v; }
-inline vec3 operator*( const mat4& m, const vec3& v ){ vec4 v1 = m*vec4(v.x,v.y,v.z,1); return vec3(v1.x,v1.y,v1.z); }
-inline vec3 operator*( const vec3& v, const mat4& m ){ vec4 v1 = vec4(v.x,v.y,v.z,1)*m; return vec3(v1.x,v1.y,v1.z); }
-inline float dot( const vec2& v1, const vec2& v2){ return v1.dot(v2); }
-inline float dot( const vec3& v1, const vec3& v2){ return v1.dot(v2); }
-inline float dot( const vec4& v1, const vec4& v2){ return v1.dot(v2); }
-inline vec3 cross( const vec3& v1, const vec3& v2){ return v1.cross(v2); }
+constexpr vec3 mul( const vec3& v, const mat3& m ){ return m.transpose()*v; }
+constexpr vec4 mul( const vec4& v, const mat4& m ){ return m.transpose()*v; }
+constexpr vec3 mul( const mat3& m, const vec3& v ){ return m*v; }
+constexpr vec4 mul( const mat4& m, const vec4& v ){ return m*v; }
+constexpr vec3 operator*( const vec3& v, const mat3& m ){ return m.transpose()*v; }
+constexpr vec4 operator*( const vec4& v, const mat4& m ){ return m.transpose()*v; }
+constexpr vec3 operator*( const mat4& m, const vec3& v ){ vec4 v1 = m*vec4(v.x,v.y,v.z,1); return vec3(v1.x,v1.y,v1.z); }
+constexpr vec3 operator*( const vec3& v, const mat4& m ){ vec4 v1 = vec4(v.x,v.y,v.z,1)*m; return vec3(v1.x,v1.y,v1.z); }
+constexpr float dot( const vec2& v1, const vec2& v2){ return v1.dot(v2); }
+constexpr float dot( const vec3& v1, const vec3& v2){ return v1.dot(v2); }
+constexpr float dot( const vec4& v1, const vec4& v2){ return v1.dot(v2); }
+constexpr vec3 cross( const vec3& v1, const vec3& v2){ return v1.cross(v2); }
+
+//*******************************************************************
+// batched transformations of arrays: out[k] = m*in[k] for k in [0,n)
+// SSE/NEON kernels take four elements at once and transpose them into SoA registers (x0..x3, y0..y3, z0..z3);
+// results are identical to the per-element operators. in and out may be the same array, but should not partially overlap.
+inline mat3 normal_matrix( const mat4& m );	// inverse-transpose of the upper-left 3x3 part
+inline void transform_points( const mat4& m, const vec3* in, vec3* out, size_t n );		// w=1 without division: the same as m*in[k]
+inline void transform_vectors( const mat4& m, const vec3* in, vec3* out, size_t n );	// w=0: directions without translation
+inline void transform_normals( const mat4& m, const vec3* in, vec3* out, size_t n );	// normalize(normal_matrix(m)*in[k])
+inline void transform_points( const mat4& m, const vec4* in, vec4* out, size_t n );		// homogeneous coordinates
+inline void project_points( const mat4& m, const vec3* in, vec3* out, size_t n );		// w=1 with perspective division: e.g., to NDC
+
+inline mat3 normal_matrix( const mat4& m )
+{
+	// transposed 3x3 block of the affine inverse; singular matrices yield zeros
+	mat4 i = m.inverse_affine();
+	return mat3( i._11, i._21, i._31, i._12, i._22, i._32, i._13, i._23, i._33 );
+}
+
+// kernel for vec3 arrays: w is 1 for points and 0 for vectors, followed by optional perspective division or normalization
+inline void _cgmath_transform3( const mat4& m, const vec3* in, vec3* out, size_t n, float w, bool b_divide, bool b_normalize )
+{
+	static_assert( sizeof(vec3)==12, "vec3 should be tightly packed" );
+	const float* a=m.a; float t0=a[3]*w, t1=a[7]*w, t2=a[11]*w, t3=a[15]*w; // translations scaled by w
+	size_t k=0;
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)
+	__m128 m0=_mm_set1_ps(a[0]), m1=_mm_set1_ps(a[1]), m2=_mm_set1_ps(a[2]), m3=_mm_set1_ps(t0);
+	__m128 m4=_mm_set1_ps(a[4]), m5=_mm_set1_ps(a[5]), m6=_mm_set1_ps(a[6]), m7=_mm_set1_ps(t1);
+	__m128 m8=_mm_set1_ps(a[8]), m9=_mm_set1_ps(a[9]), m10=_mm_set1_ps(a[10]), m11=_mm_set1_ps(t2);
+	for( ; k+4 <= n; k+=4 )
+	{
+		// [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] to [x0 x1 x2 x3] [y0 y1 y2 y3] [z0 z1 z2 z3]
+		const float* p=&in[k].x; __m128 l0=_mm_loadu_ps(p), l1=_mm_loadu_ps(p+4), l2=_mm_loadu_ps(p+8);
+		__m128 x = _mm_shuffle_ps( l0, _mm_shuffle_ps(l1,l2,_MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0) );
+		__m128 y = _mm_shuffle_ps( _mm_shuffle_ps(l0,l1,_MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(l1,l2,_MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0) );
+		__m128 z = _mm_shuffle_ps( _mm_shuffle_ps(l0,l1,_MM_SHUFFLE(1,1,2,2)), _mm_shuffle_ps(l2,l2,_MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0) );
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m0,x),_mm_mul_ps(m1,y)),_mm_mul_ps(m2,z)),m3);
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m4,x),_mm_mul_ps(m5,y)),_mm_mul_ps(m6,z)),m7);
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m8,x),_mm_mul_ps(m9,y)),_mm_mul_ps(m10,z)),m11);
+		if(b_divide){ __m128 rw=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[12]),x),_mm_mul_ps(_mm_set1_ps(a[13]),y)),_mm_mul_ps(_mm_set1_ps(a[14]),z)),_mm_set1_ps(t3)); rx=_mm_div_ps(rx,rw); ry=_mm_div_ps(ry,rw); rz=_mm_div_ps(rz,rw); }
+		if(b_normalize){ __m128 l=_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx,rx),_mm_mul_ps(ry,ry)),_mm_mul_ps(rz,rz))); rx=_mm_div_ps(rx,l); ry=_mm_div_ps(ry,l); rz=_mm_div_ps(rz,l); }
+		// back to [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3]
+		float* q=&out[k].x;
+		_mm_storeu_ps( q,   _mm_shuffle_ps(_mm_shuffle_ps(rx,ry,_MM_SHUFFLE(0,0,0,0)),_mm_shuffle_ps(rz,rx,_MM_SHUFFLE(1,1,0,0)),_MM_SHUFFLE(2,0,2,0)) );
+		_mm_storeu_ps( q+4, _mm_shuffle_ps(_mm_shuffle_ps(ry,rz,_MM_SHUFFLE(1,1,1,1)),_mm_shuffle_ps(rx,ry,_MM_SHUFFLE(2,2,2,2)),_MM_SHUFFLE(2,0,2,0)) );
+		_mm_storeu_ps( q+8, _mm_shuffle_ps(_mm_shuffle_ps(rz,rx,_MM_SHUFFLE(3,3,2,2)),_mm_shuffle_ps(ry,rz,_MM_SHUFFLE(3,3,3,3)),_MM_SHUFFLE(2,0,2,0)) );
+	}
+#elif defined(CGMATH_NEON)
+	auto row = [&]( const float32x4x3_t& v, int r, float t ){ return vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(v.val[0],a[r*4]),vmulq_n_f32(v.val[1],a[r*4+1])),vmulq_n_f32(v.val[2],a[r*4+2])),vdupq_n_f32(t)); };
+	for( ; k+4 <= n; k+=4 )
+	{
+		float32x4x3_t v=vld3q_f32(&in[k].x), r; // de-interleaved loads and interleaved stores
+		r.val[0]=row(v,0,t0); r.val[1]=row(v,1,t1); r.val[2]=row(v,2,t2);
+		if(b_divide){ float32x4_t rw=row(v,3,t3); for( int j=0; j < 3; j++ ) r.val[j]=vdivq_f32(r.val[j],rw); }
+		if(b_normalize){ float32x4_t l=vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(r.val[0],r.val[0]),vmulq_f32(r.val[1],r.val[1])),vmulq_f32(r.val[2],r.val[2]))); for( int j=0; j < 3; j++ ) r.val[j]=vdivq_f32(r.val[j],l); }
+		vst3q_f32( &out[k].x, r );
+	}
+#endif
+	for( ; k < n; k++ )
+	{
+		float x=in[k].x, y=in[k].y, z=in[k].z;
+		vec3 r( a[0]*x+a[1]*y+a[2]*z+t0, a[4]*x+a[5]*y+a[6]*z+t1, a[8]*x+a[9]*y+a[10]*z+t2 );
+		if(b_divide) r = r/(a[12]*x+a[13]*y+a[14]*z+t3);
+		if(b_normalize) r = r.normalize();
+		out[k] = r;
+	}
+}
+
+inline void transform_points( const mat4& m, const vec3* in, vec3* out, size_t n ){ _cgmath_transform3( m, in, out, n, 1.0f, false, false ); }
+inline void transform_vectors( const mat4& m, const vec3* in, vec3* out, size_t n ){ _cgmath_transform3( m, in, out, n, 0.0f, false, false ); }
+inline mat4 _cgmath_normal_mat4( const mat4& m ){ mat3 t=normal_matrix(m); return mat4( t._11, t._12, t._13, 0, t._21, t._22, t._23, 0, t._31, t._32, t._33, 0, 0, 0, 0, 1 ); }
+inline void transform_normals( const mat4& m, const vec3* in, vec3* out, size_t n ){ _cgmath_transform3( _cgmath_normal_mat4(m), in, out, n, 0.0f, false, true ); }
+inline void project_points( const mat4& m, const vec3* in, vec3* out, size_t n ){ _cgmath_transform3( m, in, out, n, 1.0f, true, false ); }
+
+inline void transform_points( const mat4& m, const vec4* in, vec4* out, size_t n )
+{
+	size_t k=0;
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)
+	const float* a=m.a; __m128 c[16]; for( int j=0; j < 16; j++ ) c[j]=_mm_set1_ps(a[j]);
+	for( ; k+4 <= n; k+=4 )
+	{
+		__m128 x=_mm_loadu_ps(&in[k].x), y=_mm_loadu_ps(&in[k+1].x), z=_mm_loadu_ps(&in[k+2].x), w=_mm_loadu_ps(&in[k+3].x);
+		_MM_TRANSPOSE4_PS( x, y, z, w );
+		__m128 r[4]; for( int j=0; j < 4; j++ ) r[j] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c[j*4],x),_mm_mul_ps(c[j*4+1],y)),_mm_mul_ps(c[j*4+2],z)),_mm_mul_ps(c[j*4+3],w));
+		_MM_TRANSPOSE4_PS( r[0], r[1], r[2], r[3] );
+		for( int j=0; j < 4; j++ ) _mm_storeu_ps( &out[k+j].x, r[j] );
+	}
+#elif defined(CGMATH_NEON)
+	const float* a=m.a;
+	for( ; k+4 <= n; k+=4 )
+	{
+		float32x4x4_t v=vld4q_f32(&in[k].x), r;
+		for( int j=0; j < 4; j++ ) r.val[j] = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(v.val[0],a[j*4]),vmulq_n_f32(v.val[1],a[j*4+1])),vmulq_n_f32(v.val[2],a[j*4+2])),vmulq_n_f32(v.val[3],a[j*4+3]));
+		vst4q_f32( &out[k].x, r );
+	}
+#endif
+	for( ; k < n; k++ ) out[k] = m*in[k];
+}
+
+// parallel versions for large arrays: P provides parallel_for(n,chunk,f(begin,end)) such as worker_pool of a1
+template <class P, class F> void _cgmath_parallel( P* pool, size_t n, F f ){ const size_t chunk=4096; if(pool&&n>chunk*2) pool->parallel_for( n, chunk, f ); else f( size_t(0), n ); }
+template <class P> void transform_points( const mat4& m, const vec3* in, vec3* out, size_t n, P* pool ){ _cgmath_parallel( pool, n, [&]( size_t b, size_t e ){ transform_points(m,in+b,out+b,e-b); } ); }
+template <class P> void transform_vectors( const mat4& m, const vec3* in, vec3* out, size_t n, P* pool ){ _cgmath_parallel( pool, n, [&]( size_t b, size_t e ){ transform_vectors(m,in+b,out+b,e-b); } ); }
+template <class P> void transform_normals( const mat4& m, const vec3* in, vec3* out, size_t n, P* pool ){ mat4 t=_cgmath_normal_mat4(m); _cgmath_parallel( pool, n, [&]( size_t b, size_t e ){ _cgmath_transform3(t,in+b,out+b,e-b,0.0f,false,true); } ); }
+template <class P> void transform_points( const mat4& m, const vec4* in, vec4* out, size_t n, P* pool ){ _cgmath_parallel( pool, n, [&]( size_t b, size_t e ){ transform_points(m,in+b,out+b,e-b); } ); }
+template <class P> void project_points( const mat4& m, const vec3* in, vec3* out, size_t n, P* pool ){ _cgmath_parallel( pool, n, [&]( size_t b, size_t e ){ project_points(m,in+b,out+b,e-b); } ); }
+
+//*******************************************************************
+// view-frustum culling with bounding spheres
+// planes are extracted from the rows of a clip matrix such as projection*view (Gribb and Hartmann 2001):
+// dot(plane,vec4(p,1)) is the signed distance of p to the plane, positive inside; a clip matrix with the model matrix gives planes in object space
+struct frustum
+{
+	vec4	planes[6];	// left, right, bottom, top, near, far
+
+	frustum() = default;
+	explicit frustum( const mat4& m );
+	bool intersect( const vec3& center, float radius ) const { for( const vec4& p : planes ) if(p.x*center.x+p.y*center.y+p.z*center.z+p.w < -radius) return false; return true; }
+	bool intersect( const vec4& sphere ) const { return intersect( vec3(sphere.x,sphere.y,sphere.z), sphere.w ); }
+};
+
+inline frustum::frustum( const mat4& m )
+{
+	const float* a=m.a; vec4 r[4]; for( int j=0; j < 4; j++ ) r[j] = vec4( a[j*4], a[j*4+1], a[j*4+2], a[j*4+3] );
+	for( int j=0; j < 3; j++ ){ planes[j*2] = r[3]+r[j]; planes[j*2+1] = r[3]-r[j]; } // -w <= x,y,z <= w
+	for( vec4& p : planes ){ float l=sqrtf(p.x*p.x+p.y*p.y+p.z*p.z); if(l>0) p = p/l; }
+}
+
+// batched sphere tests of (center,radius) in spheres: visible[k] = f.intersect(spheres[k]) for k in [0,n), and returns the number of visible spheres
+// SSE/NEON kernels take four spheres at once, and reject them plane by plane in SoA registers
+inline size_t cull_spheres( const frustum& f, const vec4* spheres, size_t n, uchar* visible )
+{
+	size_t k=0, count=0;
+#if defined(CGMATH_AVX)||defined(CGMATH_SSE)
+	for( ; k+4 <= n; k+=4 )
+	{
+		__m128 x=_mm_loadu_ps(&spheres[k].x), y=_mm_loadu_ps(&spheres[k+1].x), z=_mm_loadu_ps(&spheres[k+2].x), r=_mm_loadu_ps(&spheres[k+3].x);
+		_MM_TRANSPOSE4_PS( x, y, z, r );
+		__m128 nr=_mm_sub_ps(_mm_setzero_ps(),r), inside=_mm_castsi128_ps(_mm_set1_epi32(-1));
+		for( const vec4& p : f.planes )
+		{
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x),x),_mm_mul_ps(_mm_set1_ps(p.y),y)),_mm_mul_ps(_mm_set1_ps(p.z),z)),_mm_set1_ps(p.w));
+			inside = _mm_and_ps( inside, _mm_cmpge_ps(d,nr) );
+		}
+		int mask=_mm_movemask_ps(inside);
+		for( int j=0; j < 4; j++ ){ visible[k+j] = uchar((mask>>j)&1); count += (mask>>j)&1; }
+	}
+#elif defined(CGMATH_NEON)
+	for( ; k+4 <= n; k+=4 )
+	{
+		float32x4x4_t v=vld4q_f32(&spheres[k].x); // x, y, z, and radius of four spheres
+		float32x4_t nr=vnegq_f32(v.val[3]); uint32x4_t inside=vdupq_n_u32(~0u);
+		for( const vec4& p : f.planes )
+		{
+			float32x4_t d = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_n_f32(v.val[0],p.x),vmulq_n_f32(v.val[1],p.y)),vmulq_n_f32(v.val[2],p.z)),vdupq_n_f32(p.w));
+			inside = vandq_u32( inside, vcgeq_f32(d,nr) );
+		}
+		uint32_t b[4]; vst1q_u32( b, inside );
+		for( int j=0; j < 4; j++ ){ visible[k+j] = uchar(b[j]&1); count += b[j]&1; }
+	}
+#endif
+	for( ; k < n; k++ ){ visible[k] = uchar(f.intersect(spheres[k])); count += visible[k]; }
+	return count;
+}
 
 //*******************************************************************
 // utility math functions
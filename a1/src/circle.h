@@ -2,8 +2,12 @@
 #ifndef __CIRCLE_H__
 #define __CIRCLE_H__
 
+#include "worker_pool.h"
+
 static const float VELOCITY_SCALE = 2.5f;			// SCALE for velocity
 
+struct circle_grid_t; // uniform-grid broad phase: defined below
+
 // This is class, all public
 // _t: declare type name
 struct circle_t
@@ -14,54 +18,153 @@ struct circle_t
 	float	radius=1.0f;				// radius
 	float	theta=0.0f;					// rotation angle
 	vec4	color;						// RGBA color in [0,1]
-	mat4	model_matrix;				// modeling transformation
 	float	lvoc = 0.0;					// level of collision
+	vec2	prev_pos = vec2(0);			// position at the previous fixed step for interpolated rendering
 
 	// public functions
-	void	update( float t, float dt, float x_bound, float y_bound, std::vector<circle_t>& circles);
+	size_t	update( float t, float dt, float x_bound, float y_bound, std::vector<circle_t>& circles, const circle_grid_t* grid=nullptr );	// returns the number of pair tests
+	void	integrate( float t, float dt, float x_bound, float y_bound );	// movement and wall reflections
+	void	resolve( circle_t& other );	// narrow phase: elastic response against one circle
+	size_t	find_contacts( uint i, const std::vector<circle_t>& circles, const circle_grid_t* grid, std::vector<uvec2>& out ) const; // appends overlapping pairs (i,j) of this i-th circle, j>i or j after i in the grid; returns the number of pair tests
 	float   collide(const circle_t& other);
 	float	collide(const std::vector<circle_t>& circles);
+	vec2	interpolate( float alpha ) const { return prev_pos+(pos-prev_pos)*alpha; } // render-time position between fixed steps
+	mat4	model_matrix() const;		// modeling transformation of the current state, built only for rendering
+};
+
+// counters for profiling the collision phases
+struct collision_stats_t
+{
+	std::atomic<size_t>	pair_tests = 0;		// number of narrow-phase tests since the last reset
+	static collision_stats_t& instance(){ static collision_stats_t s; return s; }
+};
+
+// uniform grid over the walls, rebuilt once per frame by counting sort
+// cell size is the max diameter, so overlapping pairs are always in the 3x3 neighborhood
+struct circle_grid_t
+{
+	vec2				origin = vec2(0);	// bottom-left corner of the walls
+	float				cell_size = 1.0f;	// width and height of a cell
+	ivec2				dim = ivec2(0);		// number of cells along x and y
+	std::vector<uint>	cell_start;			// offsets into cell_items; size = dim.x*dim.y+1
+	std::vector<uint>	cell_items;			// circle indices sorted by cell
+	std::vector<uint>	cell_index;			// cell index of each circle
+	std::vector<uint>	cell_rank;			// position of each circle in cell_items
+	std::vector<std::vector<uvec2>>	contacts;		// overlapping pairs found by each chunk of cells in the last step
+	std::vector<std::vector<uvec3>>	contact_runs;	// (cell, begin, end) of the pairs of each cell in its chunk of contacts
+	std::vector<uvec3>	batches[9];			// (chunk, begin, end) of the pairs of the cells of each batch of resolve_contacts()
+
+	inline ivec2 cell( const vec2& p ) const { return ivec2( clamp(int((p.x-origin.x)/cell_size),0,dim.x-1), clamp(int((p.y-origin.y)/cell_size),0,dim.y-1) ); }
+	void build( const std::vector<circle_t>& circles, float x_bound, float y_bound );
+	template <class P> void build( size_t count, P pos, float max_radius, float x_bound, float y_bound ); // pos(k) returns the center of k-th circle
+	template <class F> void for_each_neighbor( const vec2& p, F f ) const;
+	template <class F> void for_each_later( uint i, F f ) const; // the circles of the 3x3 cells of circle i after it in cell_items, so each pair is visited once
 };
 
+// seedable random numbers owned by each simulation (PCG32), instead of the global rand() of randf()
+// the same seed reproduces the same sequence on every platform and run
+struct circle_rng_t
+{
+	uint64_t state = 0;
+
+	circle_rng_t( uint64_t seed=0 ){ next(); state += seed; next(); }
+	uint	next(){ uint64_t s=state; state=s*6364136223846793005ULL+1442695040888963407ULL; uint x=uint(((s>>18)^s)>>27), r=uint(s>>59); return (x>>r)|(x<<((32-r)&31)); }
+	float	operator()(){ return (next()>>8)*(1.0f/16777216.0f); } // [0,1) with 24-bit mantissa
+	float	operator()( float fmin, float fmax ){ return (*this)()*(fmax-fmin)+fmin; }
+};
+
+// accumulator of the fixed-timestep simulation
+// frame times are consumed in fixed steps of substeps, so the result depends only on the number of steps;
+// the remainder is carried to the next frame, and render() interpolates by alpha() between the last two steps
+struct fixed_step_t
+{
+	float	step = 1/120.0f;		// fixed timestep in the simulation time
+	uint	substeps = 2;			// integration substeps per step
+	uint	max_steps = 8;			// steps per frame; longer frames slow down the simulation instead of spiraling
+	double	time = 0.0;				// simulation time after the last step
+	double	accumulator = 0.0;		// frame time not simulated yet
+
+	float	substep() const { return step/float(substeps); }
+	float	alpha() const { return float(accumulator/step); }
+	double	render_time() const { return time-step*(1.0-alpha()); } // simulation time interpolated for rendering
+	void	reset( double t=0.0 ){ time = t; accumulator = 0.0; }
+	uint	advance( double frame_dt ) // returns the number of steps to run in this frame
+	{
+		accumulator = std::min( accumulator+std::max(frame_dt,0.0), double(step)*max_steps );
+		uint n = uint(accumulator/step); accumulator -= double(step)*n;
+		return n;
+	}
+};
+
+// M = TRS of a circle
+inline mat4 circle_matrix( vec2 pos, float radius, float theta )
+{
+	float c=cos(theta), s=sin(theta);
+	return mat4
+	{
+		radius*c,-radius*s, 0, pos.x,
+		radius*s, radius*c, 0, pos.y,
+		0, 0, 1, 0,
+		0, 0, 0, 1
+	};
+}
+
 // why inline? 
 // header ϸ inline 
 // ѹ ϱ ؼ
 // no discard?
 // Don't discard output result
-// create circles
-inline [[nodiscard]] std::vector<circle_t> create_circles( uint count, float x_bound, float y_bound )
+// create circles by dart throwing on a background grid: each dart is tested only against the circles
+// in its 3x3 cells, so placement is near-linear in count instead of scanning all the placed circles
+[[nodiscard]] inline std::vector<circle_t> create_circles( uint count, float x_bound, float y_bound, uint64_t seed=0 )
 {	
+	static const uint max_darts = 1024;	// darts per circle before giving up
+
 	// define circles vector
-	std::vector<circle_t> circles;
+	std::vector<circle_t> circles; circles.reserve(count);
+	circle_rng_t rng(seed); // every draw is a separate statement, since the order of argument evaluation is unspecified
+
+	// cell size is the max diameter, so overlapping circles are always in the 3x3 neighborhood
+	float cell_size = 0.2f*4 / float(sqrt(count)) * 2.0f, area = 0.0f;
+	ivec2 dim = ivec2( std::max(1,int(ceil(x_bound*2.0f/cell_size))), std::max(1,int(ceil(y_bound*2.0f/cell_size))) );
+	std::vector<uint> head( size_t(dim.x)*dim.y, ~0u ), next; next.reserve(count); // linked list of circles in each cell
+	auto cell = [&]( const vec2& p ){ return ivec2( clamp(int((p.x+x_bound)/cell_size),0,dim.x-1), clamp(int((p.y+y_bound)/cell_size),0,dim.y-1) ); };
 
 	// loop over count
-	for (uint k = 0,  kn = 1024, n=0; k < kn && n<count; k++) {
+	for (uint n = 0; n < count; n++) {
 		// define circle
 		circle_t c;
 
 		// generate random instance of a circle ( see formula in HW1 pdf file )
-		c.radius = randf(0.05f, 0.2f)*4 / float(sqrt(count));
+		c.radius = rng(0.05f, 0.2f)*4 / float(sqrt(count));
 
-		// random position according to x bound and y bound
-		c.pos = vec2(
-			randf(-x_bound + c.radius, x_bound - c.radius),
-			randf(-y_bound + c.radius, y_bound - c.radius)
-		);
+		// throw darts until one avoids collision with nearby circles
+		bool collision_exists = true;
+		for (uint k = 0; k < max_darts && collision_exists; k++) {
+			// random position according to x bound and y bound
+			c.pos.x = rng(-x_bound + c.radius, x_bound - c.radius);
+			c.pos.y = rng(-y_bound + c.radius, y_bound - c.radius);
 
-		// test if any collision exists
-		bool collision_exists = false;
-		for (auto& d : circles )
-			if (d.collide(c) > 0) { collision_exists = true; break; }
+			// test if any collision exists
+			collision_exists = false;
+			ivec2 q = cell(c.pos);
+			for( int y=std::max(q.y-1,0), y1=std::min(q.y+1,dim.y-1); y <= y1 && !collision_exists; y++ )
+				for( int x=std::max(q.x-1,0), x1=std::min(q.x+1,dim.x-1); x <= x1 && !collision_exists; x++ )
+					for( uint i=head[size_t(y)*dim.x+x]; i!=~0u && !collision_exists; i=next[i] ) collision_exists = c.collide(circles[i]) > 0;
+		}
+		if (collision_exists) { printf( "%s(): placed only %u of %u circles; no room after %u darts with %.0f%% of the walls covered\n", __func__, n, count, max_darts, area/(x_bound*y_bound*4)*100 ); break; }
+		c.prev_pos = c.pos;
+		area += PI*c.radius*c.radius;
 
-		if (collision_exists) continue; // collision exist
-		
 		// emplace circles now, since it avoids collision
-		c.color = vec4(randf3(0.0f, 1.0f), 1.0f);
-		c.velocity = randf2(-1.0f, 1.0f) * VELOCITY_SCALE;
+		c.color = vec4(0, 0, 0, 1.0f);
+		for (int j = 0; j < 3; j++) c.color[j] = rng(0.0f, 1.0f);
+		for (int j = 0; j < 2; j++) c.velocity[j] = rng(-1.0f, 1.0f) * VELOCITY_SCALE;
 
-		// push to circles
+		// push to circles and the grid
+		ivec2 q = cell(c.pos); uint& h = head[size_t(q.y)*dim.x+q.x];
+		next.push_back(h); h = n;
 		circles.emplace_back(c);
-		n++;
 	}
 
 	return circles;
@@ -92,92 +195,215 @@ inline float circle_t::collide( const std::vector<circle_t>& circles )
 }
 
 // how to update radius? this is class update function
-inline void circle_t::update( float t, float dt , float x_bound, float y_bound, std::vector<circle_t>& circles)
+inline size_t circle_t::update( float t, float dt , float x_bound, float y_bound, std::vector<circle_t>& circles, const circle_grid_t* grid )
+{
+	integrate( t, dt, x_bound, y_bound );
+
+	// avoid collision with other circles: only nearby circles with the grid
+	size_t tests = 0;
+	if(grid)	grid->for_each_neighbor( pos, [&]( uint k ){ resolve(circles[k]); tests += &circles[k]!=this; } );
+	else		for( auto& d : circles ){ resolve(d); tests += &d!=this; }
+	return tests;
+}
+
+inline void circle_t::integrate( float t, float dt, float x_bound, float y_bound )
 {
 	// suppose t as a current time
 	theta	= t;
-	float c	= cos(theta), s=sin(theta);
 
-	// these transformations will be explained in later transformation lecture
-	mat4 scale_matrix =
-	{
-		radius, 0, 0, 0,
-		0, radius, 0, 0,
-		0, 0, 1, 0,
-		0, 0, 0, 1
-	};
-
-	mat4 rotation_matrix =
-	{
-		c,-s, 0, 0,
-		s, c, 0, 0,
-		0, 0, 1, 0,
-		0, 0, 0, 1
-	};
-
-	mat4 translate_matrix =
-	{
-		1, 0, 0, pos.x,
-		0, 1, 0, pos.y,
-		0, 0, 1, 0,
-		0, 0, 0, 1
-	};
-	
-	// circle movement
-	pos += velocity * dt * VELOCITY_SCALE;
+	// circle movement: the same rounding as circle_soa::integrate()
+	pos += velocity * (dt * VELOCITY_SCALE);
 
 	// avoid collision with walls
-	if (pos.x - radius < -x_bound) {		// left wall collision
+	if (pos.x < radius - x_bound) {			// left wall collision
 		pos.x = -x_bound + radius;
 		velocity.x = -velocity.x;
 	}
-	else if (pos.x + radius > x_bound) {	// right wall collision
+	else if (pos.x > x_bound - radius) {	// right wall collision
 		pos.x = x_bound - radius;
 		velocity.x = -velocity.x;
 	}
-	if (pos.y - radius < -y_bound) {		// below wall collision
+	if (pos.y < radius - y_bound) {			// below wall collision
 		pos.y = -y_bound + radius;
 		velocity.y = -velocity.y;
 	}
-	else if (pos.y + radius > y_bound) {	// above wall collision
+	else if (pos.y > y_bound - radius) {	// above wall collision
 		pos.y = y_bound - radius;
 		velocity.y = -velocity.y;
 	}
+}
+
+// M = TRS, the same as circle_soa::model_matrix()
+inline mat4 circle_t::model_matrix() const { return circle_matrix( pos, radius, theta ); }
+
+// elastic response against a single circle
+inline void circle_t::resolve( circle_t& d )
+{
+	if (&d == this) return; // skip current circle
 
-	// avoid collision with other circles
-	float collision_impact = 0.0f;
+	// calculate collision impact
+	float collision_impact = collide(d);
+	if (collision_impact <= 0) return;
 
-	for (auto& d : circles) {
-		if (&d == this) continue; // skip current circle
+	// check distance of center
+	float d_center = length(pos - d.pos);
+	if (d_center == 0.0f) return;
 
-		// calculate collision impact
-		collision_impact = collide(d);
+	// two center's normal vector
+	vec2 normal = (pos - d.pos) / d_center;
 
-		if (collision_impact > 0) { // collision
-			// check distance of center
-			float d_center = length(pos - d.pos);
-			if (d_center == 0.0f) continue;
+	// calculate relative Velocity between circles
+	vec2 relativeVelocity = velocity - d.velocity;
 
-			// two center's normal vector
-			vec2 normal = (pos - d.pos) / d_center;
+	// change to scalar value
+	float scalar = dot(relativeVelocity, normal);
 
-			// calculate relative Velocity between circles
-			vec2 relativeVelocity = velocity - d.velocity;
+	// two circles is going to collision
+	if (scalar < 0) {
+		// elastic collision
+		velocity -= scalar * normal;
+		d.velocity += scalar * normal;
+	}
+}
 
-			// change to scalar value
-			float scalar = dot(relativeVelocity, normal);
+// overlap test of the later circles only, so that each pair is found once
+inline size_t circle_t::find_contacts( uint i, const std::vector<circle_t>& circles, const circle_grid_t* grid, std::vector<uvec2>& out ) const
+{
+	size_t tests = 0;
+	auto test = [&]( uint j ){ vec2 d=pos-circles[j].pos; float rr=radius+circles[j].radius; tests++; if(dot(d,d) < rr*rr) out.emplace_back(i,j); };
+	if(grid)	grid->for_each_later( i, test );
+	else		for( uint j=i+1, n=uint(circles.size()); j < n; j++ ) test(j);
+	return tests;
+}
 
-			// two circles is going to collision
-			if (scalar < 0) {
-				// elastic collision
-				velocity -= scalar * normal;
-				d.velocity += scalar * normal;
-			}
+// contact phase of the two-phase step, shared by simulate_circles() and circle_soa::update():
+// find(i,out) collects the overlapping pairs of circle i over chunks in parallel, and then resolve(i,j) applies them.
+// each pair is resolved once and symmetrically with the latest velocities, so every resolution is an elastic
+// exchange of two circles and no energy is gained in dense clusters.
+// with the grid, the pairs are found over chunks of cells, and resolved in parallel in 9 batches of cells 3 apart
+// along x and y: the pairs of a cell touch only its 3x3 neighborhood, so no circle is touched by two workers in a batch.
+// one worker resolves the pairs of a cell in order, so each circle sees its pairs in the same order for any number of threads.
+// without the grid, the pairs (i,j>i) are resolved serially in the order of i and j.
+template <class F, class R> void resolve_contacts( size_t n, size_t chunk, circle_grid_t* grid, worker_pool* pool, F find, R resolve )
+{
+	if(!grid)
+	{
+		std::vector<std::vector<uvec2>> contacts( (n+chunk-1)/chunk );
+		auto f = [&]( size_t b, size_t e ){ auto& c=contacts[b/chunk]; size_t tests=0; for( size_t k=b; k < e; k++ ) tests += find( uint(k), c ); collision_stats_t::instance().pair_tests += tests; };
+		if(pool) pool->parallel_for( n, chunk, f ); else f( size_t(0), n );
+		for( auto& c : contacts ) for( auto& q : c ) resolve( q.x, q.y );
+		return;
+	}
+
+	// the grid keeps the allocations across steps
+	const ivec2 dim = grid->dim; size_t cells = size_t(dim.x)*dim.y, chunks = (cells+chunk-1)/chunk;
+	auto& contacts = grid->contacts; contacts.resize( chunks );
+	auto& contact_runs = grid->contact_runs; contact_runs.resize( chunks );
+	auto f = [&]( size_t b, size_t e )
+	{
+		auto& c = contacts[b/chunk]; auto& runs = contact_runs[b/chunk]; c.clear(); runs.clear();
+		size_t tests = 0;
+		for( size_t cell=b; cell < e; cell++ )
+		{
+			uint m = uint(c.size());
+			for( uint r=grid->cell_start[cell]; r < grid->cell_start[cell+1]; r++ ) tests += find( grid->cell_items[r], c );
+			if(c.size()>m) runs.emplace_back( uint(cell), m, uint(c.size()) );
 		}
+		collision_stats_t::instance().pair_tests += tests;
+	};
+	if(pool) pool->parallel_for( cells, chunk, f ); else for( size_t b=0; b < cells; b+=chunk ) f( b, std::min(b+chunk,cells) );
+
+	// the pair lists of the cells of each batch
+	for( auto& b : grid->batches ) b.clear();
+	for( size_t k=0; k < chunks; k++ ) for( auto& r : contact_runs[k] )
+	{
+		uint x = r.x%uint(dim.x), y = r.x/uint(dim.x);
+		grid->batches[(y%3)*3+x%3].emplace_back( uint(k), r.y, r.z );
 	}
 
-	// M = TRS
-	model_matrix = translate_matrix*rotation_matrix*scale_matrix;
+	static const size_t run_chunk = 16;
+	for( auto& batch : grid->batches )
+	{
+		auto g = [&]( size_t b, size_t e ){ for( size_t k=b; k < e; k++ ){ const uvec3& r=batch[k]; const auto& c=contacts[r.x]; for( uint m=r.y; m < r.z; m++ ) resolve( c[m].x, c[m].y ); } };
+		if(pool&&batch.size()>run_chunk) pool->parallel_for( batch.size(), run_chunk, g ); else g( size_t(0), batch.size() );
+	}
+}
+
+// two-phase step over circle chunks on a worker pool (or serially without a pool):
+// integrate, and then find the contacts of the integrated state and resolve them by resolve_contacts().
+// the contacts are applied in the same order for any chunking, so the result does not depend on the threads.
+inline void simulate_circles( std::vector<circle_t>& circles, float t, float dt, float x_bound, float y_bound, circle_grid_t* grid, worker_pool* pool=nullptr )
+{
+	static const size_t chunk = 256;
+	auto integrate = [&]( size_t b, size_t e ){ for( size_t k=b; k < e; k++ ) circles[k].integrate( t, dt, x_bound, y_bound ); };
+	if(pool) pool->parallel_for( circles.size(), chunk, integrate ); else integrate( size_t(0), circles.size() );
+
+	if(grid) grid->build( circles, x_bound, y_bound );
+	resolve_contacts( circles.size(), chunk, grid, pool,
+		[&]( uint i, std::vector<uvec2>& out ){ return circles[i].find_contacts( i, circles, grid, out ); },
+		[&]( uint i, uint j ){ circles[i].resolve(circles[j]); } );
+}
+
+// FNV-1a hash of positions and velocities to compare deterministic runs bit by bit
+inline uint64_t circle_hash( uint64_t h, float f ){ uint u; memcpy(&u,&f,sizeof(u)); for( int k=0; k < 4; k++ ){ h ^= (u>>(k*8))&0xff; h *= 1099511628211ULL; } return h; }
+inline uint64_t circle_state_hash( const std::vector<circle_t>& circles )
+{
+	uint64_t h = 14695981039346656037ULL;
+	for( auto& c : circles ) for( float f : {c.pos.x,c.pos.y,c.velocity.x,c.velocity.y} ) h = circle_hash(h,f);
+	return h;
+}
+
+inline void circle_grid_t::build( const std::vector<circle_t>& circles, float x_bound, float y_bound )
+{
+	float max_radius = 0.0f; for( auto& c : circles ) max_radius = std::max(max_radius, c.radius);
+	build( circles.size(), [&]( size_t k ){ return circles[k].pos; }, max_radius, x_bound, y_bound );
+}
+
+template <class P> void circle_grid_t::build( size_t count, P pos, float max_radius, float x_bound, float y_bound )
+{
+	// cell size from the largest circle; cap the cell count for tiny radii
+	origin = vec2(-x_bound, -y_bound);
+	cell_size = std::max(max_radius*2.0f, std::max(x_bound, y_bound)*2.0f/1024.0f);
+	dim = ivec2( std::max(1,int(ceil(x_bound*2.0f/cell_size))), std::max(1,int(ceil(y_bound*2.0f/cell_size))) );
+
+	// counting sort of circle indices by cell
+	cell_start.assign( size_t(dim.x)*dim.y+1, 0 );
+	cell_index.resize( count );
+	for( size_t k=0; k < count; k++ )
+	{
+		ivec2 c = cell(pos(k));
+		cell_index[k] = uint(c.y*dim.x+c.x);
+		cell_start[cell_index[k]+1]++;
+	}
+	for( size_t k=1; k < cell_start.size(); k++ ) cell_start[k] += cell_start[k-1];
+
+	cell_items.resize( count ); cell_rank.resize( count );
+	std::vector<uint> cursor( cell_start.begin(), cell_start.end()-1 );
+	for( size_t k=0; k < count; k++ ){ uint r = cursor[cell_index[k]]++; cell_items[r] = uint(k); cell_rank[k] = r; }
+}
+
+template <class F> void circle_grid_t::for_each_neighbor( const vec2& p, F f ) const
+{
+	if(cell_start.empty()) return;
+	ivec2 c = cell(p);
+	for( int y=std::max(c.y-1,0), y1=std::min(c.y+1,dim.y-1); y <= y1; y++ )
+		for( int x=std::max(c.x-1,0), x1=std::min(c.x+1,dim.x-1); x <= x1; x++ )
+		{
+			uint i = uint(y*dim.x+x);
+			for( uint k=cell_start[i]; k < cell_start[i+1]; k++ ) f(cell_items[k]);
+		}
+}
+
+template <class F> void circle_grid_t::for_each_later( uint i, F f ) const
+{
+	// the cells before the cell of i hold no later circle, and its own cell only those after i
+	uint c = cell_index[i]; int cx = int(c%uint(dim.x)), cy = int(c/uint(dim.x));
+	for( int y=std::max(cy-1,0), y1=std::min(cy+1,dim.y-1); y <= y1; y++ )
+		for( int x=std::max(cx-1,0), x1=std::min(cx+1,dim.x-1); x <= x1; x++ )
+		{
+			uint k = uint(y*dim.x+x); if(k < c) continue;
+			for( uint r=k==c?cell_rank[i]+1:cell_start[k]; r < cell_start[k+1]; r++ ) f(cell_items[r]);
+		}
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,275 @@
+#pragma once
+#ifndef __CIRCLE_CCD_H__
+#define __CIRCLE_CCD_H__
+
+#include "circle_soa.h"
+
+// sweep-and-prune broad phase over x-intervals of the swept circles
+// the order of entries persists across steps, so insertion sort runs in near-linear time under temporal coherence
+struct circle_sap_t
+{
+	struct entry_t { float lo, hi, ylo, yhi; uint i; };	// swept bounds of circle i
+	std::vector<entry_t>				entries;		// sorted by lo
+	std::vector<std::pair<uint,uint>>	pairs;			// overlapping bounds of the last update
+	size_t	swaps = 0;				// insertion-sort swaps of the last update; falls back to std::sort beyond 8 per circle
+	bool	b_rebuild = true;		// sort from scratch at the next update, e.g., after the circles are reset
+
+	template <class B> void update( size_t n, B bounds ); // bounds(k) returns vec4(xlo,xhi,ylo,yhi) of k-th circle
+};
+
+template <class B> void circle_sap_t::update( size_t n, B bounds )
+{
+	if(entries.size()!=n){ entries.resize(n); b_rebuild = true; }
+	if(b_rebuild) for( uint k=0; k < n; k++ ) entries[k].i = k;
+	for( auto& e : entries ){ vec4 b=bounds(e.i); e.lo=b.x; e.hi=b.y; e.ylo=b.z; e.yhi=b.w; }
+
+	swaps = 0;
+	if(b_rebuild) std::sort( entries.begin(), entries.end(), []( const entry_t& a, const entry_t& b ){ return a.lo<b.lo; } );
+	else for( size_t k=1; k < n; k++ )
+	{
+		entry_t e = entries[k]; size_t j=k;
+		for( ; j>0 && entries[j-1].lo>e.lo; j-- ) entries[j] = entries[j-1];
+		entries[j] = e; swaps += k-j;
+		if(swaps > n*8){ std::sort( entries.begin(), entries.end(), []( const entry_t& a, const entry_t& b ){ return a.lo<b.lo; } ); break; } // incoherent motion
+	}
+	b_rebuild = false;
+
+	// sweep along x, and then reject by y
+	pairs.clear();
+	for( size_t a=0; a < n; a++ )
+	{
+		const entry_t& e = entries[a];
+		for( size_t b=a+1; b < n && entries[b].lo <= e.hi; b++ )
+		{
+			const entry_t& f = entries[b];
+			if(f.ylo <= e.yhi && e.ylo <= f.yhi) pairs.emplace_back( std::min(e.i,f.i), std::max(e.i,f.i) );
+		}
+	}
+}
+
+// time of impact in [0,1] of two circles at relative position dp moving by dv, or 2 for no impact;
+// the smaller root of |dp+dv*u| = rr in the numerically stable form, and 0 for approaching overlaps
+inline float circle_toi( vec2 dp, vec2 dv, float rr )
+{
+	float b = dot(dp,dv), c = dot(dp,dp)-rr*rr;
+	if(b >= 0) return 2.0f;				// separating
+	if(c <= 0) return 0.0f;				// already overlapping and approaching
+	float disc = b*b-dot(dv,dv)*c;
+	return disc < 0 ? 2.0f : c/(-b+sqrtf(disc));
+}
+
+// continuous collision detection of a step: candidate pairs from the swept bounds, and then
+// collisions with circles and walls are resolved one by one in the order of their times of impact.
+// every event is an elastic exchange of two circles, so no energy is gained in dense clusters,
+// and fast circles do not tunnel through each other or walls at large timesteps.
+// a circle deflected out of its swept bounds grows them over the rest of its new path, and the circles whose bounds
+// the growth overlaps become its candidates through a coarse grid of the bounds, so no deflected path goes unchecked.
+struct circle_ccd_t
+{
+	struct event_t
+	{
+		float	t;			// time of impact as a fraction of the step
+		uint	i, j;		// j is the other circle or a wall
+		uint	si, sj;		// stamps of i and j at the prediction; stale if any of them collided since
+		bool operator<( const event_t& e ) const { return t!=e.t ? t>e.t : i!=e.i ? i>e.i : j>e.j; } // reversed for a min-heap
+	};
+	static const uint WALL_X = ~0u, WALL_Y = ~1u;
+
+	std::vector<vec2>	p, v;			// positions and velocities of the circles in the current step
+	std::vector<float>	r;				// radii
+	std::vector<float>	tc;				// time of each circle's position, advanced lazily to events
+	std::vector<uint>	stamp;			// number of collisions of each circle in the current step
+	std::vector<uint>	mark;			// last deflection whose candidates listed each circle, for the lookups of deflect()
+	std::vector<uint>	adj_start, adj;	// candidate neighbors of each circle in the CSR layout
+	std::vector<uint>	adj_head;		// first of the candidates added to each circle during the step, or ~0u
+	std::vector<uvec2>	adj_links;		// (neighbor, next) of the added candidates
+	std::vector<vec4>	box;			// swept bounds (xlo,xhi,ylo,yhi) of each circle, grown by deflections
+
+	// coarse grid of the swept bounds for the deflected circles: each circle is listed in every cell its bounds overlap
+	vec2				cell_origin = vec2(0);
+	float				cell_size = 1.0f;
+	ivec2				cell_dim = ivec2(0);
+	std::vector<uint>	cell_start, cell_items;	// circles of each cell in the CSR layout at the start of the step
+	std::vector<uint>	cell_head;				// first of the circles added to each cell by grown bounds, or ~0u
+	std::vector<uvec2>	cell_links;				// (circle, next) of the added circles
+
+	std::vector<event_t> heap;
+	circle_sap_t		sap;
+	size_t				events = 0;		// collisions resolved in the last step
+	size_t				deflections = 0;	// circles deflected out of their swept bounds in the last step
+	size_t				tests = 0;		// pair tests of the last step; added to collision_stats_t once per step
+	float				s = 0, x_bound = 1, y_bound = 1;
+
+	// public functions: the same usage as simulate_circles() and circle_soa::update()
+	void	update( std::vector<circle_t>& circles, float t, float dt, float x_bound, float y_bound );
+	void	update( circle_soa& soa, float t, float dt, float x_bound, float y_bound );
+	void	step( float dt, float x_bound, float y_bound );
+
+	void	advance( uint i, float t ){ p[i] += v[i]*(s*(t-tc[i])); tc[i] = t; }
+	void	push( float t, uint i, uint j ){ if(t<=1.0f){ heap.push_back({t,i,j,stamp[i],j<WALL_Y?stamp[j]:0}); std::push_heap(heap.begin(),heap.end()); } }
+	void	predict_pair( uint i, uint j );
+	void	predict_walls( uint i );
+	void	predict( uint i ){ predict_walls(i); for( uint k=adj_start[i]; k < adj_start[i+1]; k++ ) predict_pair( i, adj[k] ); for( uint k=adj_head[i]; k!=~0u; k=adj_links[k].y ) predict_pair( i, adj_links[k].x ); }
+	void	deflect( uint i );	// after the velocity of i changed: grows its bounds and adds the new candidates
+	ivec4	cells( const vec4& b ) const { return ivec4( clamp(int((b.x-cell_origin.x)/cell_size),0,cell_dim.x-1), clamp(int((b.y-cell_origin.x)/cell_size),0,cell_dim.x-1), clamp(int((b.z-cell_origin.y)/cell_size),0,cell_dim.y-1), clamp(int((b.w-cell_origin.y)/cell_size),0,cell_dim.y-1) ); } // (x0,x1,y0,y1)
+	void	build_cells();
+};
+
+inline void circle_ccd_t::build_cells()
+{
+	// cell size is twice the mean extent of the bounds, so most bounds overlap a few cells and the fast ones span more
+	size_t n = p.size(); float extent = 0;
+	for( auto& b : box ) extent += (b.y-b.x)+(b.w-b.z);
+	cell_origin = vec2(-x_bound,-y_bound); cell_size = std::max( extent/std::max(n,size_t(1)), 1e-6f );
+	cell_dim = ivec2( clamp(int(ceil(x_bound*2.0f/cell_size)),1,1024), clamp(int(ceil(y_bound*2.0f/cell_size)),1,1024) );
+	cell_size = std::max( x_bound*2.0f/cell_dim.x, y_bound*2.0f/cell_dim.y );
+
+	size_t cell_count = size_t(cell_dim.x)*cell_dim.y;
+	cell_start.assign( cell_count+1, 0 ); cell_head.assign( cell_count, ~0u ); cell_links.clear();
+	for( size_t k=0; k < n; k++ ){ ivec4 c=cells(box[k]); for( int y=c.z; y<=c.w; y++ ) for( int x=c.x; x<=c.y; x++ ) cell_start[y*cell_dim.x+x+1]++; }
+	for( size_t k=1; k <= cell_count; k++ ) cell_start[k] += cell_start[k-1];
+	cell_items.resize( cell_start[cell_count] );
+	std::vector<uint> cursor( cell_start.begin(), cell_start.end()-1 );
+	for( uint k=0; k < n; k++ ){ ivec4 c=cells(box[k]); for( int y=c.z; y<=c.w; y++ ) for( int x=c.x; x<=c.y; x++ ) cell_items[cursor[y*cell_dim.x+x]++] = k; }
+}
+
+inline void circle_ccd_t::deflect( uint i )
+{
+	// bounds of the rest of the path
+	vec2 q = p[i]+v[i]*(s*(1.0f-tc[i]));
+	vec4 b( std::min(p[i].x,q.x)-r[i], std::max(p[i].x,q.x)+r[i], std::min(p[i].y,q.y)-r[i], std::max(p[i].y,q.y)+r[i] );
+	vec4& a = box[i];
+	if(a.x <= b.x && b.y <= a.y && a.z <= b.z && b.w <= a.w) return; // the old bounds already overlap every circle the new path can reach
+	deflections++; uint m = uint(deflections);
+
+	// list i in the cells of the grown bounds, which it was not in yet
+	ivec4 c0 = cells(a);
+	a = vec4( std::min(a.x,b.x), std::max(a.y,b.y), std::min(a.z,b.z), std::max(a.w,b.w) );
+	ivec4 c1 = cells(a);
+	for( int y=c1.z; y<=c1.w; y++ ) for( int x=c1.x; x<=c1.y; x++ )
+	{
+		if(x>=c0.x&&x<=c0.y&&y>=c0.z&&y<=c0.w) continue;
+		uint& h = cell_head[y*cell_dim.x+x]; cell_links.emplace_back( i, h ); h = uint(cell_links.size()-1);
+	}
+
+	// the circles whose bounds overlap the rest of the path become candidates of i, and i of them
+	mark[i] = m;
+	for( uint k=adj_start[i]; k < adj_start[i+1]; k++ ) mark[adj[k]] = m;
+	for( uint k=adj_head[i]; k!=~0u; k=adj_links[k].y ) mark[adj_links[k].x] = m;
+	auto visit = [&]( uint j )
+	{
+		const vec4& e = box[j];
+		if(mark[j]==m || e.x>b.y || b.x>e.y || e.z>b.w || b.z>e.w) return;
+		mark[j] = m;
+		adj_links.emplace_back( j, adj_head[i] ); adj_head[i] = uint(adj_links.size()-1);
+		adj_links.emplace_back( i, adj_head[j] ); adj_head[j] = uint(adj_links.size()-1);
+	};
+	ivec4 cb = cells(b);
+	for( int y=cb.z; y<=cb.w; y++ ) for( int x=cb.x; x<=cb.y; x++ )
+	{
+		uint cell = y*cell_dim.x+x;
+		for( uint k=cell_start[cell]; k < cell_start[cell+1]; k++ ) visit( cell_items[k] );
+		for( uint k=cell_head[cell]; k!=~0u; k=cell_links[k].y ) visit( cell_links[k].x );
+	}
+}
+
+inline void circle_ccd_t::predict_pair( uint i, uint j )
+{
+	float t0 = std::max(tc[i],tc[j]);
+	vec2 pi = p[i]+v[i]*(s*(t0-tc[i])), pj = p[j]+v[j]*(s*(t0-tc[j]));
+	float u = circle_toi( pi-pj, (v[i]-v[j])*s, r[i]+r[j] );
+	tests++;
+	push( t0+u, i, j ); // u is also a fraction of the whole step
+}
+
+inline void circle_ccd_t::predict_walls( uint i )
+{
+	auto wall = [&]( float x, float vx, float bound, uint w )
+	{
+		if(vx==0) return;
+		float target = vx>0 ? bound-r[i] : r[i]-bound;
+		push( tc[i]+std::max((target-x)/(vx*s),0.0f), i, w );
+	};
+	wall( p[i].x, v[i].x, x_bound, WALL_X );
+	wall( p[i].y, v[i].y, y_bound, WALL_Y );
+}
+
+inline void circle_ccd_t::step( float dt, float xb, float yb )
+{
+	size_t n = p.size();
+	s = dt*VELOCITY_SCALE; x_bound = xb; y_bound = yb;
+
+	// broad phase: per-axis intervals of the straight paths in the step, swept on x and rejected by y
+	box.resize( n );
+	for( size_t k=0; k < n; k++ ){ vec2 q=p[k]+v[k]*s; box[k] = vec4( std::min(p[k].x,q.x)-r[k], std::max(p[k].x,q.x)+r[k], std::min(p[k].y,q.y)-r[k], std::max(p[k].y,q.y)+r[k] ); }
+	sap.update( n, [&]( size_t k ){ return box[k]; } );
+	adj_start.assign( n+1, 0 ); adj.resize( sap.pairs.size()*2 );
+	for( auto& q : sap.pairs ){ adj_start[q.first+1]++; adj_start[q.second+1]++; }
+	for( size_t k=1; k <= n; k++ ) adj_start[k] += adj_start[k-1];
+	std::vector<uint> cursor( adj_start.begin(), adj_start.end()-1 );
+	for( auto& q : sap.pairs ){ adj[cursor[q.first]++] = q.second; adj[cursor[q.second]++] = q.first; }
+
+	// initial predictions: each pair once
+	tc.assign( n, 0.0f ); stamp.assign( n, 0 ); heap.clear(); tests = 0;
+	adj_head.assign( n, ~0u ); adj_links.clear(); mark.assign( n, 0 ); deflections = 0; build_cells();
+	for( uint k=0; k < n; k++ ) predict_walls( k );
+	for( auto& q : sap.pairs ) predict_pair( q.first, q.second );
+
+	// narrow phase in the order of times of impact; the cap guards against endless zero-time contacts
+	events = 0;
+	for( size_t max_events=n*16+1024; !heap.empty() && events < max_events; )
+	{
+		std::pop_heap( heap.begin(), heap.end() ); event_t e = heap.back(); heap.pop_back();
+		uint i=e.i, j=e.j;
+		if(e.si!=stamp[i] || (j<WALL_Y && e.sj!=stamp[j])) continue;
+
+		advance( i, e.t );
+		if(j==WALL_X){ v[i].x = -v[i].x; p[i].x = clamp( p[i].x, -x_bound+r[i], x_bound-r[i] ); }
+		else if(j==WALL_Y){ v[i].y = -v[i].y; p[i].y = clamp( p[i].y, -y_bound+r[i], y_bound-r[i] ); }
+		else
+		{
+			// elastic response: the same as circle_t::resolve()
+			advance( j, e.t );
+			vec2 normal = p[i]-p[j]; float d = length(normal);
+			float scalar = d>0 ? dot(v[i]-v[j],normal/d) : 0.0f;
+			if(scalar<0){ v[i] -= scalar*normal/d; v[j] += scalar*normal/d; }
+			stamp[j]++;
+		}
+		stamp[i]++; events++;
+		deflect( i ); if(j<WALL_Y) deflect( j );
+		predict( i ); if(j<WALL_Y) predict( j );
+	}
+
+	for( uint k=0; k < n; k++ )
+	{
+		advance( k, 1.0f );
+		p[k].x = clamp( p[k].x, -x_bound+r[k], x_bound-r[k] );
+		p[k].y = clamp( p[k].y, -y_bound+r[k], y_bound-r[k] );
+	}
+	collision_stats_t::instance().pair_tests += tests;
+}
+
+inline void circle_ccd_t::update( std::vector<circle_t>& circles, float t, float dt, float xb, float yb )
+{
+	size_t n = circles.size();
+	p.resize(n); v.resize(n); r.resize(n);
+	for( size_t k=0; k < n; k++ ){ p[k] = circles[k].pos; v[k] = circles[k].velocity; r[k] = circles[k].radius; }
+	step( dt, xb, yb );
+	for( size_t k=0; k < n; k++ )
+	{
+		circle_t& c = circles[k];
+		c.pos = p[k]; c.velocity = v[k]; c.theta = t;
+	}
+}
+
+inline void circle_ccd_t::update( circle_soa& soa, float t, float dt, float xb, float yb )
+{
+	size_t n = soa.size();
+	p.resize(n); v.resize(n); r.resize(n);
+	for( size_t k=0; k < n; k++ ){ p[k] = vec2(soa.x[k],soa.y[k]); v[k] = vec2(soa.vx[k],soa.vy[k]); r[k] = soa.r[k]; }
+	step( dt, xb, yb );
+	for( size_t k=0; k < n; k++ ){ soa.x[k] = p[k].x; soa.y[k] = p[k].y; soa.vx[k] = v[k].x; soa.vy[k] = v[k].y; }
+	soa.theta = t;
+}
+
+#endif
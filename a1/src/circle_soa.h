@@ -0,0 +1,184 @@
+#pragma once
+#ifndef __CIRCLE_SOA_H__
+#define __CIRCLE_SOA_H__
+
+#include "circle.h"
+
+// SIMD instruction sets are selected at compile time (e.g., -mavx or /arch:AVX)
+#if defined(__AVX__)
+	#define CIRCLE_SOA_AVX
+	#include <immintrin.h>
+#elif defined(__SSE2__)||defined(_M_X64)||(defined(_M_IX86_FP)&&_M_IX86_FP>=2)
+	#define CIRCLE_SOA_SSE
+	#include <emmintrin.h>
+#endif
+
+// structure-of-arrays circle store
+// integration streams only x/y/vx/vy/r; color is cold data only read for rendering
+struct circle_soa
+{
+	std::vector<float>	x, y;			// 2D positions
+	std::vector<float>	vx, vy;			// velocities
+	std::vector<float>	r;				// radii
+	std::vector<vec4>	color;			// RGBA colors in [0,1]
+	std::vector<float>	px, py;			// positions at the previous fixed step for interpolated rendering
+	float	theta = 0.0f;				// rotation angle shared by all circles
+	float	max_radius = 0.0f;			// largest radius for the broad phase
+
+	circle_soa() = default;
+	circle_soa( const std::vector<circle_t>& circles ){ assign(circles); }
+	size_t	size() const { return x.size(); }
+
+	// public functions: the same usage as circle_t, but for all circles at once
+	void	assign( const std::vector<circle_t>& circles );
+	void	update( float t, float dt, float x_bound, float y_bound, circle_grid_t* grid=nullptr, worker_pool* pool=nullptr );
+	void	integrate( float dt, float x_bound, float y_bound, size_t begin, size_t end );	// movement and wall reflections
+	size_t	find_contacts( uint i, const circle_grid_t* grid, std::vector<uvec2>& out ) const; // appends overlapping pairs (i,j), j>i or j after i in the grid; returns the number of pair tests
+	void	resolve( uint i, uint j );	// narrow phase: elastic response of circles i and j
+	mat4	model_matrix( size_t k ) const { return circle_matrix( vec2(x[k],y[k]), r[k], theta ); }
+	vec2	interpolate( size_t k, float alpha ) const { return vec2( px[k]+(x[k]-px[k])*alpha, py[k]+(y[k]-py[k])*alpha ); }
+	void	save_state(){ px = x; py = y; } // at the start of a fixed step
+
+	// per-axis wall reflection: p += v*s, then clamp p to [-bound+r,bound-r] with v negated
+	static void reflect( float& p, float& v, float r, float s, float bound );
+#if defined(CIRCLE_SOA_AVX)
+	static void reflect( float* p, float* v, const float* r, __m256 s, __m256 bound );
+#elif defined(CIRCLE_SOA_SSE)
+	static void reflect( float* p, float* v, const float* r, __m128 s, __m128 bound );
+#endif
+};
+
+inline void circle_soa::assign( const std::vector<circle_t>& circles )
+{
+	size_t n = circles.size();
+	x.resize(n); y.resize(n); vx.resize(n); vy.resize(n); r.resize(n); color.resize(n); px.resize(n); py.resize(n);
+	max_radius = 0.0f;
+	for( size_t k=0; k < n; k++ )
+	{
+		const circle_t& c = circles[k];
+		x[k] = c.pos.x;			y[k] = c.pos.y;
+		px[k] = c.prev_pos.x;	py[k] = c.prev_pos.y;
+		vx[k] = c.velocity.x;	vy[k] = c.velocity.y;
+		r[k] = c.radius;		color[k] = c.color;
+		max_radius = std::max(max_radius, c.radius);
+	}
+}
+
+inline void circle_soa::reflect( float& p, float& v, float r, float s, float bound )
+{
+	p += v*s;
+	if(p < r - bound){ p = -bound + r; v = -v; }
+	else if(p > bound - r){ p = bound - r; v = -v; }
+}
+
+#if defined(CIRCLE_SOA_AVX)
+inline void circle_soa::reflect( float* p, float* v, const float* r, __m256 s, __m256 bound )
+{
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 vp=_mm256_loadu_ps(p), vv=_mm256_loadu_ps(v), vr=_mm256_loadu_ps(r);
+	vp = _mm256_add_ps( vp, _mm256_mul_ps(vv,s) );
+
+	__m256 lo = _mm256_sub_ps(vr,bound), hi = _mm256_sub_ps(bound,vr);
+	__m256 ml = _mm256_cmp_ps(vp,lo,_CMP_LT_OQ);
+	__m256 mh = _mm256_andnot_ps( ml, _mm256_cmp_ps(vp,hi,_CMP_GT_OQ) ); // else-if of the scalar version
+	vp = _mm256_blendv_ps( _mm256_blendv_ps(vp,hi,mh), lo, ml );
+	vv = _mm256_xor_ps( vv, _mm256_and_ps(_mm256_or_ps(ml,mh),sign) );
+
+	_mm256_storeu_ps(p,vp); _mm256_storeu_ps(v,vv);
+}
+#elif defined(CIRCLE_SOA_SSE)
+inline void circle_soa::reflect( float* p, float* v, const float* r, __m128 s, __m128 bound )
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 vp=_mm_loadu_ps(p), vv=_mm_loadu_ps(v), vr=_mm_loadu_ps(r);
+	vp = _mm_add_ps( vp, _mm_mul_ps(vv,s) );
+
+	__m128 lo = _mm_sub_ps(vr,bound), hi = _mm_sub_ps(bound,vr);
+	__m128 ml = _mm_cmplt_ps(vp,lo);
+	__m128 mh = _mm_andnot_ps( ml, _mm_cmpgt_ps(vp,hi) ); // else-if of the scalar version
+	__m128 m = _mm_or_ps(ml,mh);
+	vp = _mm_or_ps( _mm_andnot_ps(m,vp), _mm_or_ps(_mm_and_ps(ml,lo),_mm_and_ps(mh,hi)) ); // SSE2 has no blendv
+	vv = _mm_xor_ps( vv, _mm_and_ps(m,sign) );
+
+	_mm_storeu_ps(p,vp); _mm_storeu_ps(v,vv);
+}
+#endif
+
+inline void circle_soa::integrate( float dt, float x_bound, float y_bound, size_t begin, size_t end )
+{
+	float s = dt*VELOCITY_SCALE;
+	size_t k=begin, n=end;
+
+	// 8 (AVX) or 4 (SSE) circles per instruction, and scalar for the remainder
+#if defined(CIRCLE_SOA_AVX)
+	__m256 s8=_mm256_set1_ps(s), xb=_mm256_set1_ps(x_bound), yb=_mm256_set1_ps(y_bound);
+	for( ; k+8 <= n; k+=8 )
+	{
+		reflect( &x[k], &vx[k], &r[k], s8, xb );
+		reflect( &y[k], &vy[k], &r[k], s8, yb );
+	}
+#elif defined(CIRCLE_SOA_SSE)
+	__m128 s4=_mm_set1_ps(s), xb=_mm_set1_ps(x_bound), yb=_mm_set1_ps(y_bound);
+	for( ; k+4 <= n; k+=4 )
+	{
+		reflect( &x[k], &vx[k], &r[k], s4, xb );
+		reflect( &y[k], &vy[k], &r[k], s4, yb );
+	}
+#endif
+	for( ; k < n; k++ )
+	{
+		reflect( x[k], vx[k], r[k], s, x_bound );
+		reflect( y[k], vy[k], r[k], s, y_bound );
+	}
+}
+
+// the same tests as circle_t::find_contacts()
+inline size_t circle_soa::find_contacts( uint i, const circle_grid_t* grid, std::vector<uvec2>& out ) const
+{
+	size_t tests = 0;
+	auto test = [&]( uint j ){ float dx=x[i]-x[j], dy=y[i]-y[j], rr=r[i]+r[j]; tests++; if(dx*dx+dy*dy < rr*rr) out.emplace_back(i,j); };
+	if(grid)	grid->for_each_later( i, test );
+	else		for( uint j=i+1, n=uint(size()); j < n; j++ ) test(j);
+	return tests;
+}
+
+// the same operations as circle_t::resolve(), so both stores produce the same bits
+inline void circle_soa::resolve( uint i, uint j )
+{
+	float dx=x[i]-x[j], dy=y[i]-y[j], d_center=sqrtf(dx*dx+dy*dy);
+	if(d_center >= r[i]+r[j] || d_center == 0.0f) return;
+
+	// normal vector and relative velocity along it
+	float nx = dx/d_center, ny = dy/d_center;
+	float scalar = (vx[i]-vx[j])*nx + (vy[i]-vy[j])*ny;
+
+	// two circles is going to collision
+	if(scalar < 0){ vx[i] -= scalar*nx; vy[i] -= scalar*ny; vx[j] += scalar*nx; vy[j] += scalar*ny; }
+}
+
+// two-phase step over chunks of circles: see simulate_circles() in circle.h
+inline void circle_soa::update( float t, float dt, float x_bound, float y_bound, circle_grid_t* grid, worker_pool* pool )
+{
+	// suppose t as a current time
+	theta = t;
+
+	static const size_t chunk = 256; // multiple of SIMD width
+	size_t n = size();
+	auto for_chunks = [&]( auto f ){ if(pool) pool->parallel_for( n, chunk, f ); else f( size_t(0), n ); };
+
+	for_chunks( [&]( size_t b, size_t e ){ integrate( dt, x_bound, y_bound, b, e ); } );
+	if(grid) grid->build( n, [&]( size_t k ){ return vec2(x[k],y[k]); }, max_radius, x_bound, y_bound );
+	resolve_contacts( n, chunk, grid, pool,
+		[&]( uint i, std::vector<uvec2>& out ){ return find_contacts( i, grid, out ); },
+		[&]( uint i, uint j ){ resolve( i, j ); } );
+}
+
+// the same bits as circle_state_hash() of the circles in the same state
+inline uint64_t circle_state_hash( const circle_soa& s )
+{
+	uint64_t h = 14695981039346656037ULL;
+	for( size_t k=0, n=s.size(); k < n; k++ ) for( float f : {s.x[k],s.y[k],s.vx[k],s.vy[k]} ) h = circle_hash(h,f);
+	return h;
+}
+
+#endif
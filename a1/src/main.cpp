@@ -1,6 +1,8 @@
 #include "cgmath.h"		// slee's simple math library
 #include "cgut.h"		// slee's OpenGL utility
 #include "circle.h"		// circle class definition
+#include "circle_soa.h"	// structure-of-arrays circle store
+#include "circle_ccd.h"	// sweep-and-prune and continuous collision detection
 
 //*************************************
 // global constants
@@ -12,7 +14,7 @@ static const uint	MIN_TESS = 3;		// minimum tessellation factor (down to a trian
 static const uint	MAX_TESS = 256;		// maximum tessellation factor (up to 256 triangles)
 uint				NUM_TESS = 24;		// initial tessellation factor of the circle as a polygon
 static const uint CIRCLE_MIN = 16;		// minimum circles number 
-static const uint CIRCLE_MAX = 32;		// maximum circles number
+static const uint CIRCLE_MAX = 1<<17;	// maximum circles number
 
 //*************************************
 // window objects
@@ -21,8 +23,9 @@ ivec2		window_size = cg_default_window_size(); // initial window size
 
 //*************************************
 // OpenGL objects
-GLuint	program = 0;		// ID holder for GPU program
+cg_program	program;		// GPU program with cached uniform locations
 GLuint	vertex_array = 0;	// ID holder for vertex array object
+cg_stream_buffer	instance_stream;	// ring buffer of per-instance attributes, streamed without reallocations
 
 //*************************************
 // global variables
@@ -31,14 +34,29 @@ double	t = 0.0;						// current simulation parameter
 uint	circle_count = 16;				// current circle number
 bool	b_solid_color = true;			// use circle's color?
 bool	b_index_buffer = true;			// use index buffering?
+bool	b_grid = true;					// use uniform-grid broad phase for circle collision?
+bool	b_soa = false;					// use structure-of-arrays circle store? (set by --soa at startup)
+bool	b_instanced = false;			// draw all circles with a single instanced draw call?
+bool	b_fixed_step = true;			// simulate in fixed timesteps with interpolated rendering?
+bool	b_persistent = true;			// stream by a persistent-mapped ring buffer? (or orphaning with --orphan)
+bool	b_ccd = false;					// use sweep-and-prune and time-of-impact ordered collisions? (or run with --ccd)
+uint64_t	seed = 0;					// seed of create_circles() (set by --seed at startup)
 float	x_bound = 1.0f;					// calculated x_bound using aspect ratio for wall collision detection
 float	y_bound = 1.0f;					// calculated y_bound using aspect ratio for wall collision detection
 #ifndef GL_ES_VERSION_2_0
 bool	b_wireframe = false;
 #endif
 
+// uniform locations cached in user_init()
+struct { GLint b_solid_color=-1, aspect_matrix=-1, solid_color=-1, model_matrix=-1, b_instanced=-1; } uloc;
+
 // circles variable
 std::vector<circle_t>   circles; 
+circle_grid_t			grid;			// broad phase rebuilt every frame
+circle_soa				soa;			// circles in structure-of-arrays layout when b_soa
+worker_pool				pool;			// worker threads for simulate()
+fixed_step_t			stepper;		// accumulator of the fixed-timestep simulation
+circle_ccd_t			ccd;			// continuous collision detection when b_ccd
 struct { bool add=false, sub=false; operator bool() const { return add||sub; } } b; // flags of keys for smooth changes
 
 //*************************************
@@ -75,15 +93,37 @@ void update()
 	};
 
 	// update common uniform variables in vertex/fragment shaders
-	GLint uloc;
-	uloc = glGetUniformLocation( program, "b_solid_color" );	if(uloc>-1) glUniform1i( uloc, b_solid_color );
-	uloc = glGetUniformLocation( program, "aspect_matrix" );	if(uloc>-1) glUniformMatrix4fv( uloc, 1, GL_TRUE, aspect_matrix );
+	if(uloc.b_solid_color>-1) glUniform1i( uloc.b_solid_color, b_solid_color );
+	if(uloc.aspect_matrix>-1) glUniformMatrix4fv( uloc.aspect_matrix, 1, GL_TRUE, aspect_matrix );
 
 	// update vertex buffer by the pressed keys
 	void update_tess(); // forward declaration
 	if(b) update_tess(); 
 }
 
+// simulation stage: two-phase step on the worker pool; render() only reads its result
+void simulate_step( float t, float dt )
+{
+	if(b_ccd&&b_soa)	ccd.update( soa, t, dt, x_bound, y_bound );
+	else if(b_ccd)		ccd.update( circles, t, dt, x_bound, y_bound );
+	else if(b_soa)		soa.update( t, dt, x_bound, y_bound, b_grid?&grid:nullptr, &pool );
+	else				simulate_circles( circles, t, dt, x_bound, y_bound, b_grid?&grid:nullptr, &pool );
+}
+
+// one fixed step of substeps, keeping the previous state for interpolation; ccd needs no substeps
+void simulate_fixed_step()
+{
+	if(b_soa) soa.save_state(); else for( auto& c : circles ) c.prev_pos = c.pos;
+	uint substeps = b_ccd ? 1 : stepper.substeps;
+	for( uint k=0; k < substeps; k++ ) simulate_step( float(stepper.time+=stepper.step/substeps), stepper.step/substeps );
+}
+
+void simulate( float frame_dt )
+{
+	if(!b_fixed_step){ simulate_step( float(t), frame_dt ); return; }
+	for( uint n=stepper.advance(frame_dt); n; n-- ) simulate_fixed_step();
+}
+
 void render()
 {
 	// clear screen (with background color) and clear depth buffer
@@ -95,33 +135,58 @@ void render()
 	// bind vertex array object
 	glBindVertexArray( vertex_array );
 
-	// define t0 to store previous time
-	static double t0 = 0;	// still alive static
-	double dt = t - t0;
+	// fixed steps are drawn at the time between the last two steps
+	float alpha = stepper.alpha(), theta = float(stepper.render_time());
+
+	if(uloc.b_instanced>-1) glUniform1i( uloc.b_instanced, b_instanced );
+	if(b_instanced)
+	{
+		// pack per-instance attributes of all the circles into this frame's region of the ring, and draw them at once
+		// the ring grows between frames, and waits only if the GPU still reads the region of three frames ago
+		size_t n = b_soa?soa.size():circles.size(), offset=0;
+		instance_stream.reserve( sizeof(vec4)*n*2 );
+		instance_stream.begin_frame();
+		vec4* instance_data = (vec4*) instance_stream.map( sizeof(vec4)*n*2, offset );
+		for( size_t k=0; instance_data && k < n; k++ )
+		{
+			if(b_fixed_step){	instance_data[k*2] = vec4( b_soa?soa.interpolate(k,alpha):circles[k].interpolate(alpha), b_soa?soa.r[k]:circles[k].radius, theta );	instance_data[k*2+1] = b_soa?soa.color[k]:circles[k].color; }
+			else if(b_soa){	instance_data[k*2] = vec4( soa.x[k], soa.y[k], soa.r[k], soa.theta );	instance_data[k*2+1] = soa.color[k]; }
+			else{		const circle_t& c=circles[k]; instance_data[k*2] = vec4( c.pos, c.radius, c.theta ); instance_data[k*2+1] = c.color; }
+		}
+		instance_stream.unmap();
+		glBindBuffer( GL_ARRAY_BUFFER, instance_stream.id );
+		for( GLuint k=0; k < 2; k++ ) glVertexAttribPointer( 3+k, 4, GL_FLOAT, GL_FALSE, sizeof(vec4)*2, (GLvoid*)(offset+sizeof(vec4)*k) );
 
+		if(instance_data&&b_index_buffer)	glDrawElementsInstanced( GL_TRIANGLES, NUM_TESS*3, GL_UNSIGNED_INT, nullptr, GLsizei(n) );
+		else if(instance_data)				glDrawArraysInstanced( GL_TRIANGLES, 0, NUM_TESS*3, GLsizei(n) );
+		instance_stream.end_frame();
+	}
 	// render two circles: trigger shader program to process vertex data
-	for( auto& c : circles )
+	else for( size_t k=0, kn=b_soa?soa.size():circles.size(); k < kn; k++ )
 	{
-		// per-circle update
-		c.update(float(t), float(dt), float(x_bound), float(y_bound), circles);
+		mat4 model_matrix = b_fixed_step ? circle_matrix( b_soa?soa.interpolate(k,alpha):circles[k].interpolate(alpha), b_soa?soa.r[k]:circles[k].radius, theta )
+			: b_soa ? soa.model_matrix(k) : circles[k].model_matrix();
 
 		// update per-circle uniforms
-		GLint uloc;
-		uloc = glGetUniformLocation( program, "solid_color" );		if(uloc>-1) glUniform4fv( uloc, 1, c.color );	// pointer version
-		uloc = glGetUniformLocation( program, "model_matrix" );		if(uloc>-1) glUniformMatrix4fv( uloc, 1, GL_TRUE, c.model_matrix );
+		if(uloc.solid_color>-1) glUniform4fv( uloc.solid_color, 1, b_soa?soa.color[k]:circles[k].color );	// pointer version
+		if(uloc.model_matrix>-1) glUniformMatrix4fv( uloc.model_matrix, 1, GL_TRUE, model_matrix );
 
 		// per-circle draw calls
 		if(b_index_buffer)	glDrawElements( GL_TRIANGLES, NUM_TESS*3, GL_UNSIGNED_INT, nullptr );
 		else				glDrawArrays( GL_TRIANGLES, 0, NUM_TESS*3 ); // NUM_TESS = N
 	}
 
-	// update t
-	t0 = t;
-
 	// swap front and back buffers, and display to screen
 	glfwSwapBuffers( window );
 }
 
+void reset_circles()
+{
+	circles = create_circles(circle_count, x_bound, y_bound, seed);
+	if(b_soa) soa.assign( circles );
+	ccd.sap.b_rebuild = true;
+}
+
 void reshape( GLFWwindow* window, int width, int height )
 {
 	// set current viewport in pixels (win_x, win_y, win_width, win_height)
@@ -142,6 +207,16 @@ void print_help()
 #endif
 
 	printf("- press 'r' to reset circles\n");
+	printf("- press '[/]' to halve/double the number of circles\n");
+	printf("- press 'g' to toggle uniform-grid broad phase\n");
+	printf("- press 'b' to compare pair tests of brute-force and grid broad phases\n");
+	printf("- press 't' to measure simulation throughput over thread counts\n");
+	printf("- press 'n' to toggle instanced rendering (or run with '--instanced')\n");
+	printf("- press 'f' to toggle fixed-timestep simulation\n");
+	printf("- press 'c' to toggle continuous collision detection with sweep and prune (or run with '--ccd')\n");
+	printf("- run with '--soa' to use the structure-of-arrays circle store\n");
+	printf("- run with '--orphan' to stream instance attributes by buffer orphaning instead of persistent mapping\n");
+	printf("- run with '--seed S' to seed circles, '--count N' to set their number, and '--headless N' to print the state hash after N fixed steps\n");
 	printf( "\n" );
 }
 
@@ -209,6 +284,18 @@ void update_vertex_buffer( const std::vector<vertex>& vertices, uint N )
 	if(vertex_array) glDeleteVertexArrays(1,&vertex_array);
 	vertex_array = cg_create_vertex_array( vertex_buffer, index_buffer );
 	if(!vertex_array){ printf("%s(): failed to create vertex aray\n",__func__); return; }
+
+	// per-instance attributes at location 3 and 4, advanced once per instance
+	// pointers are moved to the region of each frame in render()
+	glBindVertexArray( vertex_array );
+	glBindBuffer( GL_ARRAY_BUFFER, instance_stream.id );
+	for( GLuint k=0; k < 2; k++ )
+	{
+		glEnableVertexAttribArray( 3+k );
+		glVertexAttribPointer( 3+k, 4, GL_FLOAT, GL_FALSE, sizeof(vec4)*2, (GLvoid*)(sizeof(vec4)*k) );
+		glVertexAttribDivisor( 3+k, 1 );
+	}
+	glBindVertexArray( 0 );
 }
 
 void update_tess()
@@ -237,6 +324,68 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 			update_vertex_buffer( unit_circle_vertices,NUM_TESS );
 			printf( "> using %s buffering\n", b_index_buffer?"index":"vertex" );
 		}
+		else if(key==GLFW_KEY_G)
+		{
+			b_grid = !b_grid;
+			printf( "> using %s broad phase\n", b_grid ? "uniform-grid" : "brute-force" );
+		}
+		else if(key==GLFW_KEY_B)
+		{
+			// run one serial step of simulate_circles() with each broad phase on copies of the current circles;
+			// the brute force is quadratic on the main thread, so it is skipped for large counts
+			static const size_t max_brute_force = 4096;
+			size_t	tests[2] = {};
+			double	ms[2] = {};
+			for( int k=0; k < 2; k++ )
+			{
+				if(!k&&circles.size()>max_brute_force) continue;
+				std::vector<circle_t> c = circles;
+				circle_grid_t g;
+				collision_stats_t::instance().pair_tests = 0;
+				double t0 = glfwGetTime();
+				simulate_circles( c, float(t), 1/60.0f, x_bound, y_bound, k?&g:nullptr );
+				ms[k] = (glfwGetTime()-t0)*1000.0;
+				tests[k] = collision_stats_t::instance().pair_tests;
+			}
+			if(circles.size()>max_brute_force) printf( "> %zu circles: brute-force skipped beyond %zu circles, grid = %zu pair tests (%.2f ms)\n", circles.size(), max_brute_force, tests[1], ms[1] );
+			else printf( "> %zu circles: brute-force = %zu pair tests (%.2f ms), grid = %zu pair tests (%.2f ms)\n", circles.size(), tests[0], ms[0], tests[1], ms[1] );
+		}
+		else if(key==GLFW_KEY_T)
+		{
+			// 60 steps of simulate() on copies of the current circles for each thread count
+			for( uint n=1, nn=std::max(1u,std::thread::hardware_concurrency()); n <= nn; n++ )
+			{
+				worker_pool p(n);
+				std::vector<circle_t> c = circles;
+				circle_soa s = soa;
+				circle_grid_t g;
+				double t0 = glfwGetTime();
+				for( int k=0; k < 60; k++ )
+				{
+					if(b_soa)	s.update( float(t), 1/60.0f, x_bound, y_bound, b_grid?&g:nullptr, &p );
+					else		simulate_circles( c, float(t), 1/60.0f, x_bound, y_bound, b_grid?&g:nullptr, &p );
+				}
+				double sec = glfwGetTime()-t0;
+				printf( "> %2u threads: %.2f M circles/sec\n", n, (b_soa?s.size():c.size())*60/sec/1000000.0 );
+			}
+		}
+		else if(key==GLFW_KEY_N)
+		{
+			b_instanced = !b_instanced;
+			printf( "> using %s rendering\n", b_instanced ? "instanced" : "per-circle" );
+		}
+		else if(key==GLFW_KEY_F)
+		{
+			b_fixed_step = !b_fixed_step;
+			stepper.reset( t );
+			printf( "> using %s simulation\n", b_fixed_step ? "fixed-timestep" : "variable-timestep" );
+		}
+		else if(key==GLFW_KEY_C)
+		{
+			b_ccd = !b_ccd;
+			ccd.sap.b_rebuild = true;
+			printf( "> using %s collisions\n", b_ccd ? "continuous (sweep and prune)" : "discrete" );
+		}
 		else if(key==GLFW_KEY_D)
 		{
 			b_solid_color = !b_solid_color;
@@ -255,7 +404,7 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 			circle_count = std::min(circle_count + 1, CIRCLE_MAX);
 			printf("> number of circles =  %u\n", circle_count);
 
-			circles = create_circles(circle_count, x_bound, y_bound);
+			reset_circles();
 		}
 		else if (key == GLFW_KEY_EQUAL && (mods & GLFW_MOD_SHIFT))	// real +
 		{
@@ -263,7 +412,7 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 			circle_count = std::min(circle_count + 1, CIRCLE_MAX);
 			printf("> number of circles =  %u\n", circle_count);
 
-			circles = create_circles(circle_count, x_bound, y_bound);
+			reset_circles();
 		}
 		else if (key == GLFW_KEY_MINUS) 
 		{	
@@ -271,14 +420,21 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 			circle_count = std::max(circle_count - 1, CIRCLE_MIN);
 			printf("> number of circles =  %u\n", circle_count);
 
-			circles = create_circles(circle_count, x_bound, y_bound);
+			reset_circles();
+		}
+		else if (key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET)
+		{
+			circle_count = key == GLFW_KEY_RIGHT_BRACKET ? std::min(circle_count * 2, CIRCLE_MAX) : std::max(circle_count / 2, CIRCLE_MIN);
+			printf("> number of circles =  %u\n", circle_count);
+
+			reset_circles();
 		}
 		else if (key == GLFW_KEY_R)
 		{
 			// just re - init circle
 			printf("> reset circles\n");
 
-			circles = create_circles(circle_count, x_bound, y_bound);
+			reset_circles();
 		}
 #endif
 	}
@@ -312,9 +468,20 @@ bool user_init()
 	glClearColor( 39/255.0f, 40/255.0f, 34/255.0f, 1.0f );	// set clear color
 	glEnable( GL_CULL_FACE );								// turn on backface culling
 	glEnable( GL_DEPTH_TEST );								// turn on depth tests
+
+	// cache uniform locations
+	uloc.b_solid_color	= program.uniform( "b_solid_color" );
+	uloc.aspect_matrix	= program.uniform( "aspect_matrix" );
+	uloc.solid_color	= program.uniform( "solid_color" );
+	uloc.model_matrix	= program.uniform( "model_matrix" );
+	uloc.b_instanced	= program.uniform( "b_instanced" );
 	
 	// create circles
-	circles = create_circles(circle_count, x_bound, y_bound);
+	reset_circles();
+
+	// triple-buffered stream of per-instance attributes; grows by itself for more circles
+	instance_stream.create( GL_ARRAY_BUFFER, sizeof(vec4)*2*CIRCLE_MIN*64, 3, b_persistent );
+	printf( "> streaming instance attributes by %s\n", instance_stream.persistent() ? "a persistent-mapped ring buffer" : "orphaning" );
 
 	// define the position of four corner vertices
 	unit_circle_vertices = std::move(create_circle_vertices( NUM_TESS ));
@@ -327,10 +494,39 @@ bool user_init()
 
 void user_finalize()
 {
+	if(instance_stream.stalls) printf( "> %zu frames waited for the GPU to release the stream buffer\n", instance_stream.stalls );
+	instance_stream.release();
+}
+
+// N fixed steps without a window: the same seed, count and store give the same hash for any thread count
+int run_headless( uint steps )
+{
+	reset_circles();
+	auto t0 = std::chrono::steady_clock::now();
+	for( uint k=0; k < steps; k++ ) simulate_fixed_step();
+	double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t0).count();
+	uint64_t h = b_soa ? circle_state_hash(soa) : circle_state_hash(circles);
+	printf( "> %u steps of %zu circles (seed %llu): hash = %016llx (%.2f ms)\n", steps, b_soa?soa.size():circles.size(), (unsigned long long)seed, (unsigned long long)h, ms );
+	return 0;
 }
 
 int main( int argc, char* argv[] )
 {
+	// select circle store at startup
+	int headless_steps = -1;
+	for( int k=1; k < argc; k++ )
+	{
+		if(strcmp(argv[k],"--soa")==0) b_soa = true;
+		else if(strcmp(argv[k],"--instanced")==0) b_instanced = true;
+		else if(strcmp(argv[k],"--ccd")==0) b_ccd = true;
+		else if(strcmp(argv[k],"--orphan")==0) b_persistent = false;
+		else if(strcmp(argv[k],"--seed")==0&&k+1<argc) seed = strtoull(argv[++k],nullptr,10);
+		else if(strcmp(argv[k],"--headless")==0&&k+1<argc) headless_steps = atoi(argv[++k]);
+		else if(strcmp(argv[k],"--count")==0&&k+1<argc) circle_count = std::min(std::max(uint(atoi(argv[++k])),CIRCLE_MIN),CIRCLE_MAX);
+	}
+	printf( "> using %s circle store\n", b_soa ? "structure-of-arrays" : "array-of-structures" );
+	if(headless_steps>=0) return run_headless( uint(headless_steps) );
+
 	// create window and initialize OpenGL extensions
 	if(!(window = cg_create_window( window_name, window_size.x, window_size.y ))){ glfwTerminate(); return 1; }
 	if(!cg_init_extensions( window )){ glfwTerminate(); return 1; }	// init OpenGL extensions
@@ -346,10 +542,12 @@ int main( int argc, char* argv[] )
 	glfwSetCursorPosCallback( window, motion );		// callback for mouse movements
 
 	// enters rendering/event loop
+	double t0 = 0;			// time of the previous frame
 	for( frame=0; !glfwWindowShouldClose(window); frame++ )
 	{
 		glfwPollEvents();	// polling and processing of events
 		update();			// per-frame update
+		simulate( float(t-t0) ); t0 = t;	// per-frame simulation
 		render();			// per-frame render
 	}
 	
@@ -0,0 +1,91 @@
+#pragma once
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// fixed-size thread pool; the calling thread works as worker 0
+struct worker_pool
+{
+	std::vector<std::thread>	threads;
+	std::mutex					mtx;
+	std::condition_variable		cv_start, cv_done;
+	std::function<void(uint)>	job;				// job(worker index) of the current dispatch
+	uint						generation = 0;		// incremented at every dispatch
+	uint						pending = 0;		// number of threads still running the job
+	bool						b_quit = false;
+
+	worker_pool( uint count=std::max(1u,std::thread::hardware_concurrency()) );
+	~worker_pool();
+	uint size() const { return uint(threads.size())+1; }
+
+	// run f(worker index) on every worker and wait until all of them return
+	void run( std::function<void(uint)> f );
+
+	// f(begin,end) over chunks of [0,n); each worker takes its own contiguous range of chunks first,
+	// and then steals remaining chunks from the other workers' ranges
+	template <class F> void parallel_for( size_t n, size_t chunk, F f );
+};
+
+inline worker_pool::worker_pool( uint count )
+{
+	for( uint k=1; k < count; k++ ) threads.emplace_back( [this,k]()
+	{
+		for( uint g=0;; )
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv_start.wait( lock, [&](){ return b_quit||generation!=g; } );
+			if(b_quit) return;
+			g = generation; lock.unlock();
+
+			job(k);
+
+			lock.lock(); if(--pending==0) cv_done.notify_one();
+		}
+	});
+}
+
+inline worker_pool::~worker_pool()
+{
+	{ std::lock_guard<std::mutex> lock(mtx); b_quit = true; }
+	cv_start.notify_all();
+	for( auto& t : threads ) t.join();
+}
+
+inline void worker_pool::run( std::function<void(uint)> f )
+{
+	if(threads.empty()){ f(0); return; }
+	{ std::lock_guard<std::mutex> lock(mtx); job = f; pending = uint(threads.size()); generation++; }
+	cv_start.notify_all();
+	f(0);
+	std::unique_lock<std::mutex> lock(mtx);
+	cv_done.wait( lock, [&](){ return pending==0; } );
+}
+
+template <class F> void worker_pool::parallel_for( size_t n, size_t chunk, F f )
+{
+	if(n==0) return;
+	struct alignas(64) range_t { std::atomic<size_t> next; size_t end; }; // padded to avoid false sharing
+	size_t chunks = (n+chunk-1)/chunk;
+	uint workers = uint(std::min(size_t(size()),chunks));
+	std::unique_ptr<range_t[]> ranges(new range_t[workers]);
+	for( uint w=0; w < workers; w++ ){ ranges[w].next = chunks*w/workers; ranges[w].end = chunks*(w+1)/workers; }
+
+	run( [&]( uint w )
+	{
+		if(w>=workers) return;
+		for( uint v=0; v < workers; v++ ) // own range first, then steal from the others
+		{
+			range_t& r = ranges[(w+v)%workers];
+			for( size_t c; (c=r.next.fetch_add(1,std::memory_order_relaxed)) < r.end; )
+				f( c*chunk, std::min(n,(c+1)*chunk) );
+		}
+	});
+}
+
+#endif
@@ -7,12 +7,31 @@ layout(location=2) in vec2 texcoord;
 uniform mat4 model_matrix;
 uniform mat4 view_projection_matrix;
 
+// (n_long, n_lat) of the procedural sphere generated from gl_VertexID without vertex buffers; (0,0) for the vertex attributes
+uniform ivec2 tessellation;
+
+const float PI = 3.141592653589793;
+
 out vec2 tc;
 
 void main()
 {
-	vec4 wpos = model_matrix * vec4(position, 1);
+	vec3 p = position;
+	vec2 t = texcoord;
+	if(tessellation.x > 0)
+	{
+		// six vertices per quad: triangles (p1, p2, p1+1) and (p2, p2+1, p1+1) as in sphere_indices()
+		int q = gl_VertexID / 6, c = gl_VertexID - q * 6;
+		int i = q / tessellation.x + int(c == 1 || c == 3 || c == 4);
+		int j = q - (q / tessellation.x) * tessellation.x + int(c == 2 || c == 4 || c == 5);
+		float theta = PI * float(i) / float(tessellation.y);
+		float phi = 2.0 * PI * float(j == tessellation.x ? 0 : j) / float(tessellation.x); // the same position on the seam
+		p = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+		t = vec2(float(j) / float(tessellation.x), 1.0 - float(i) / float(tessellation.y));
+	}
+
+	vec4 wpos = model_matrix * vec4(p, 1);
 	gl_Position = view_projection_matrix * wpos;
 
-	tc = texcoord;
+	tc = t;
 }
@@ -1,5 +1,6 @@
 #include "cgmath.h"		// slee's simple math library
 #include "cgut.h"		// slee's OpenGL utility
+#include "sphere.h"		// parametric sphere and its levels of detail
 
 //*************************************
 // global constants
@@ -30,7 +31,8 @@ ivec2		window_size = cg_default_window_size(); // initial window size
 
 //*************************************
 // OpenGL objects
-GLuint	program	= 0;	// ID holder for GPU program
+cg_program	program;	// GPU program with cached uniform locations
+GLuint		empty_vertex_array = 0;	// no attributes for the procedural sphere
 
 //*************************************
 // global variables
@@ -38,8 +40,10 @@ int		frame = 0;		// index of rendering frames
 
 //*************************************
 // scene objects
-mesh*	p_mesh = nullptr;
-camera	cam;
+sphere_lod_chain	sphere;
+mesh*				p_spheres[3] = {};	// meshes of the other generators at the edge length of 72 x 36
+camera				cam;
+mat4				view_projection_matrix;	// aspect and swizzle matrices of update()
 
 //*************************************
 // global variables for Assignment 2
@@ -48,6 +52,18 @@ bool	is_rotate = false;		// flag for rotating
 int		texture_mode = 0;		// flag for texture mode
 bool	b_wireframe = false;	// flag for wireframe
 float	angle = 0.0;			// rotation angle variable
+bool	b_auto_lod = true;		// flag for choosing the level of detail by the projected size
+uint	lod = 0;				// current level of detail
+sphere_type	generator = SPHERE_UV;	// uv sphere in levels of detail, icosphere, or cube sphere
+bool	b_procedural = false;	// flag for generating the uv sphere from gl_VertexID without buffers
+bool	b_culling = true;		// flag for frustum culling of the sphere
+struct { size_t visible=0, culled=0; } cull_stats;	// spheres of the last frame
+
+// GPU time of drawing the sphere, averaged over frames
+struct { GLuint query=0; bool b_pending=false; double msec=0; } gpu_timer;
+
+// uniform locations cached in user_init()
+struct { GLint view_projection_matrix=-1, model_matrix=-1, mode=-1, tessellation=-1; } uloc;
 	
 //*************************************
 void update()
@@ -60,13 +76,25 @@ void update()
 	cam.aspect = window_size.x / float(window_size.y);
 	cam.projection_matrix = mat4::perspective(cam.fovy, cam.aspect, cam.dnear, cam.dfar);
 	
-	// code from Assignment2 pdf
+	// code from Assignment2 pdf; the constant swizzle matrix is built at compile time
+	static constexpr mat4 swizzle_matrix = { 0,1,0,0,0,0,1,0,-1,0,0,1,0,0,0,1 };
 	mat4 aspect_matrix = mat4::scale(std::min(1 / aspect, 1.0f), std::min(aspect, 1.0f), 1.0f);
-	mat4 view_projection_matrix = aspect_matrix * mat4{ 0,1,0,0,0,0,1,0,-1,0,0,1,0,0,0,1 };
+	view_projection_matrix = aspect_matrix * swizzle_matrix;
 
-	GLint uloc;
-	uloc = glGetUniformLocation(program, "view_projection_matrix");
-	glUniformMatrix4fv(uloc, 1, GL_TRUE, view_projection_matrix);
+	glUniformMatrix4fv(uloc.view_projection_matrix, 1, GL_TRUE, view_projection_matrix);
+
+	// choose the level of detail by the projected radius in pixels; the model matrix is a rotation about the center
+	if (b_auto_lod)
+	{
+		vec4 c = view_projection_matrix * vec4(0, 0, 0, 1);
+		float radius = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			vec4 e = view_projection_matrix * vec4(k == 0, k == 1, k == 2, 1);
+			radius = std::max(radius, length(vec2((e.x / e.w - c.x / c.w) * window_size.x, (e.y / e.w - c.y / c.w) * window_size.y) * 0.5f));
+		}
+		lod = sphere.select(radius);
+	}
 }
 
 void render()
@@ -77,21 +105,53 @@ void render()
 	// notify GL that we use our own program
 	glUseProgram( program );
 	
-	// bind vertex array object
-	if (p_mesh && p_mesh->vertex_array) glBindVertexArray(p_mesh->vertex_array);
 
-	// build the model matrix 
-	mat4 model_matrix = mat4::translate(cam.at) *
-						mat4::rotate(vec3(0, 0, 1), angle) *
-						mat4::translate(-cam.at);
+	// build the model matrix: rotation about cam.at as a dual quaternion
+	quat rotation = quat::rotate(vec3(0, 0, 1), angle);
+	mat4 model_matrix = dquat(rotation, cam.at - rotation * cam.at).to_mat4();
 
 	// update the uniform model matrix and render
-	glUniformMatrix4fv(glGetUniformLocation(program, "model_matrix"), 1, GL_TRUE, model_matrix);
+	glUniformMatrix4fv(uloc.model_matrix, 1, GL_TRUE, model_matrix);
 	// give texture mode to shader as mode
-	glUniform1i(glGetUniformLocation(program, "mode"), texture_mode);
+	glUniform1i(uloc.mode, texture_mode);
 
-	// render
-	glDrawElements(GL_TRIANGLES, GLsizei(p_mesh->index_list.size()), GL_UNSIGNED_INT, nullptr);
+	// collect the GPU time of a previous frame without waiting for it
+	bool b_timed = false;
+#ifndef GL_ES_VERSION_2_0
+	if (gpu_timer.b_pending)
+	{
+		GLint available = 0; glGetQueryObjectiv(gpu_timer.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) { GLuint64 ns = 0; glGetQueryObjectui64v(gpu_timer.query, GL_QUERY_RESULT, &ns); gpu_timer.msec = gpu_timer.msec > 0 ? gpu_timer.msec * 0.9 + ns * 1e-7 : ns * 1e-6; gpu_timer.b_pending = false; }
+	}
+	if (!gpu_timer.b_pending) { glBeginQuery(GL_TIME_ELAPSED, gpu_timer.query); b_timed = true; }
+#endif
+
+	// frustum culling by the bounding sphere in object space: planes of the clip matrix with the model matrix
+	mesh* p_mesh = generator == SPHERE_UV ? sphere.p_mesh : p_spheres[generator];
+	bool b_visible = !b_culling || frustum(view_projection_matrix * model_matrix).intersect(p_mesh->bounds.sphere);
+	cull_stats.visible = b_visible ? 1 : 0; cull_stats.culled = b_visible ? 0 : 1;
+
+	// bind vertex array object and render
+	const sphere_lod& l = sphere.levels[lod];
+	if (!b_visible) {}
+	else if (generator == SPHERE_UV && b_procedural)
+	{
+		// six vertices per quad from gl_VertexID; the zero-area triangles at the poles are culled by the rasterizer
+		glUniform2i(uloc.tessellation, int(l.n_long), int(l.n_lat));
+		glBindVertexArray(empty_vertex_array);
+		glDrawArrays(GL_TRIANGLES, 0, GLsizei(6 * l.n_long * l.n_lat));
+	}
+	else
+	{
+		glUniform2i(uloc.tessellation, 0, 0);
+		if (p_mesh && p_mesh->vertex_array) glBindVertexArray(p_mesh->vertex_array);
+		if (generator == SPHERE_UV) sphere.draw(lod);
+		else glDrawElements(GL_TRIANGLES, GLsizei(p_mesh->index_list.size()), GL_UNSIGNED_INT, nullptr);
+	}
+
+#ifndef GL_ES_VERSION_2_0
+	if (b_timed) { glEndQuery(GL_TIME_ELAPSED); gpu_timer.b_pending = true; }
+#endif
 
 	// [Assignment 2 function] rotate using time and angle
 	static double t0 = 0;			// still alive static
@@ -122,6 +182,11 @@ void print_help()
 	printf("- press 'w' to toggle wireframe\n");
 	printf("- press 'd' to toggle (tc.xy,0) > (tc.xxx) > (tc.yyy)\n");
 	printf("- press 'r' to rotate the sphere\n");
+	printf("- press 'l' to toggle automatic level of detail\n");
+	printf("- press '[' or ']' to decrease or increase the level of detail\n");
+	printf("- press 'g' to toggle uv sphere > icosphere > cube sphere\n");
+	printf("- press 'p' to toggle buffered > procedural uv sphere\n");
+	printf("- press 'c' to toggle frustum culling\n");
 	printf( "\n" );
 }
 
@@ -158,6 +223,32 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 			// change rotation flag
 			is_rotate = !is_rotate;
 		}
+		else if (key == GLFW_KEY_G)
+		{
+			generator = sphere_type((generator + 1) % 3);
+			mesh* p_mesh = generator == SPHERE_UV ? nullptr : p_spheres[generator];
+			if (p_mesh) printf("> using %s of %zu vertices and %zu triangles\n", sphere_type_name(generator), p_mesh->vertex_list.size(), p_mesh->index_list.size() / 3);
+			else printf("> using %s in levels of detail\n", sphere_type_name(generator));
+		}
+		else if (key == GLFW_KEY_C)
+		{
+			b_culling = !b_culling;
+			printf("> frustum culling: %s (%zu visible, %zu culled in the last frame)\n", b_culling ? "on" : "off", cull_stats.visible, cull_stats.culled);
+		}
+		else if (key == GLFW_KEY_P)
+		{
+			// report the average of the mode being left; the average restarts from the new mode
+			printf("> %s uv sphere took %.3f ms on GPU\n", b_procedural ? "procedural" : "buffered", gpu_timer.msec);
+			b_procedural = !b_procedural; gpu_timer.msec = 0;
+			printf("> using %s uv sphere\n", b_procedural ? "procedural (gl_VertexID)" : "buffered");
+		}
+		else if (key == GLFW_KEY_L || key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET)
+		{
+			// manual levels start from the current one
+			if (key == GLFW_KEY_L) b_auto_lod = !b_auto_lod;
+			else { b_auto_lod = false; lod = key == GLFW_KEY_LEFT_BRACKET ? (lod ? lod - 1 : 0) : std::min(lod + 1, uint(sphere.levels.size() - 1)); }
+			printf("> using %s level %u (%u x %u)\n", b_auto_lod ? "automatic" : "manual", lod, sphere.levels[lod].n_long, sphere.levels[lod].n_lat);
+		}
 	}
 }
 
@@ -174,73 +265,6 @@ void motion( GLFWwindow* window, double x, double y )
 {
 }
 
-// Assignment 2
-// create sphere mesh
-inline mesh* create_sphere_mesh() 
-{
-	// define mesh
-	mesh* new_mesh = new mesh();
-
-	// 1. make sphere vertex (36 latitude and 72 longitude)
-	// loop over latitude
-	for (int latitude = 0; latitude <= 36; latitude++) {
-		// loop over longitude
-		for (int longitude = 0; longitude <= 72; longitude++) {
-			// define theta and phi
-			float theta = (float(latitude) / 36.0f) * PI;
-			float phi = (float(longitude) / 72.0f) * 2.0f * PI;
-
-			// define vertex
-			vertex v;
-
-			// N(x,y,z): formula from a2 pdf | pos and norm are same
-			v.pos = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
-			v.norm = v.pos;	// doesn't need to normalize (already normalized)
-			// T(x,y): formula from a2 pdf 
-			v.tex = vec2(phi / (2.0f * PI), 1.0f - theta / PI);
-
-			// push vertex to mesh vertex list
-			new_mesh->vertex_list.push_back(v);
-		}
-	}
-
-	// 2. make index list
-	// loop over latitude
-	for (int latitude = 0; latitude < 36; latitude++) {
-		// loop over longitude
-		for (int longitude = 0; longitude < 72; longitude++) {
-			int point1 = latitude * (72 + 1) + longitude;
-			int point2 = point1 + 72 + 1;
-
-			// triangle 1
-			new_mesh->index_list.push_back(point1);
-			new_mesh->index_list.push_back(point2);
-			new_mesh->index_list.push_back(point1 + 1);
-
-			// triangle 2
-			new_mesh->index_list.push_back(point2);
-			new_mesh->index_list.push_back(point2 + 1);
-			new_mesh->index_list.push_back(point1 + 1);
-		}
-	}
-
-	// code from cg_load_mesh()
-	// create a vertex buffer
-	glGenBuffers(1, &new_mesh->vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, new_mesh->vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertex) * new_mesh->vertex_list.size(), &new_mesh->vertex_list[0], GL_STATIC_DRAW);
-
-	// create a index buffer
-	glGenBuffers(1, &new_mesh->index_buffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, new_mesh->index_buffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * new_mesh->index_list.size(), &new_mesh->index_list[0], GL_STATIC_DRAW);
-
-	// generate vertex array object, which is mandatory for OpenGL 3.3 and higher
-	new_mesh->vertex_array = cg_create_vertex_array(new_mesh->vertex_buffer, new_mesh->index_buffer);
-	if (!new_mesh->vertex_array) { printf("%s(): failed to create vertex aray\n", __func__); return nullptr; }
-
-	return new_mesh;
-}
 bool user_init()
 {
 	// log hotkeys
@@ -251,16 +275,37 @@ bool user_init()
 	glEnable( GL_CULL_FACE );								// turn on backface culling
 	glEnable( GL_DEPTH_TEST );								// turn on depth tests
 
-	// load the mesh (in this assignment load sphere)
-	p_mesh = create_sphere_mesh();
+	// cache uniform locations
+	uloc.view_projection_matrix = program.uniform("view_projection_matrix");
+	uloc.model_matrix = program.uniform("model_matrix");
+	uloc.mode = program.uniform("mode");
+	uloc.tessellation = program.uniform("tessellation");
+
+	// vertex array object without attributes, and the timer query
+	glGenVertexArrays( 1, &empty_vertex_array );
+#ifndef GL_ES_VERSION_2_0
+	glGenQueries( 1, &gpu_timer.query );
+#endif
+
+	// load the sphere in levels of detail from 16 x 8 to 1024 x 512 (in this assignment 72 x 36)
+	sphere = create_sphere_lod_chain( 16, 8, 7 );
+
+	if(sphere.p_mesh==nullptr){ printf( "Unable to load mesh\n" ); return false; }
 
-	if(p_mesh==nullptr){ printf( "Unable to load mesh\n" ); return false; }
+	// the other generators at the same edge length of 72 x 36
+	sphere_report( 36 );
+	for( sphere_type type : { SPHERE_ICO, SPHERE_CUBE } )
+		if(!(p_spheres[type]=create_sphere_mesh( type, sphere_matched_detail(type,36) ))){ printf( "Unable to load mesh\n" ); return false; }
 
 	return true;
 }
 
 void user_finalize()
 {
+	glDeleteVertexArrays( 1, &empty_vertex_array );
+#ifndef GL_ES_VERSION_2_0
+	glDeleteQueries( 1, &gpu_timer.query );
+#endif
 }
 
 int main( int argc, char* argv[] )
@@ -0,0 +1,284 @@
+#pragma once
+#ifndef __SPHERE_H__
+#define __SPHERE_H__
+
+#include "cgmath.h"		// slee's simple math library
+#include "cgut.h"		// slee's OpenGL utility
+#include <chrono>
+#include <unordered_map>
+
+//*************************************
+// parametric unit sphere of n_long longitudes and n_lat latitudes (e.g., 72 x 36)
+// vertices on the seam and poles are duplicated for texture coordinates: T(x,y) = (phi/2PI, 1-theta/PI)
+inline size_t sphere_vertex_count( uint n_long, uint n_lat ){ return size_t(n_lat+1)*(n_long+1); }
+inline size_t sphere_index_count( uint n_long, uint n_lat ){ return size_t(n_lat-1)*n_long*6; } // without zero-area triangles at the poles
+
+// writes vertices into a presized buffer; sin/cos are evaluated once per meridian and once per ring
+inline void sphere_vertices( uint n_long, uint n_lat, vertex* out )
+{
+	std::vector<vec2> meridian(n_long+1); // (cos(phi),sin(phi))
+	for( uint j=0; j <= n_long; j++ ){ float phi=2.0f*PI*j/float(n_long); meridian[j] = vec2(cos(phi),sin(phi)); }
+
+	for( uint i=0; i <= n_lat; i++ )
+	{
+		float theta=PI*i/float(n_lat), s=sin(theta), c=cos(theta), ty=1.0f-i/float(n_lat);
+		for( uint j=0; j <= n_long; j++, out++ )
+		{
+			out->pos = out->norm = vec3( s*meridian[j].x, s*meridian[j].y, c ); // N(x,y,z) of a unit sphere
+			out->tex = vec2( j/float(n_long), ty );
+		}
+	}
+}
+
+// writes triangles into a presized buffer with indices offset by base_vertex;
+// quads are visited in column strips narrow enough for a 16-entry vertex cache to keep the previous row
+inline void sphere_indices( uint n_long, uint n_lat, uint* out, uint base_vertex=0, uint strip_width=6 )
+{
+	for( uint j0=0; j0 < n_long; j0+=strip_width )
+		for( uint i=0; i < n_lat; i++ )
+			for( uint j=j0, j1=std::min(j0+strip_width,n_long); j < j1; j++ )
+			{
+				uint p1 = base_vertex+i*(n_long+1)+j, p2 = p1+n_long+1;
+				if(i>0){ *out++ = p1; *out++ = p2; *out++ = p1+1; }				// triangle 1
+				if(i<n_lat-1){ *out++ = p2; *out++ = p2+1; *out++ = p1+1; }	// triangle 2
+			}
+}
+
+// GPU buffers of vertices and indices, and their vertex array object
+inline bool sphere_upload( mesh* m, const std::vector<vertex>& vertices, const std::vector<uint>& indices )
+{
+	glGenBuffers( 1, &m->vertex_buffer );
+	glBindBuffer( GL_ARRAY_BUFFER, m->vertex_buffer );
+	glBufferData( GL_ARRAY_BUFFER, sizeof(vertex)*vertices.size(), vertices.data(), GL_STATIC_DRAW );
+
+	glGenBuffers( 1, &m->index_buffer );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, m->index_buffer );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(uint)*indices.size(), indices.data(), GL_STATIC_DRAW );
+
+	m->vertex_array = cg_create_vertex_array( m->vertex_buffer, m->index_buffer );
+	if(!m->vertex_array){ printf( "%s(): failed to create vertex array\n", __func__ ); return false; }
+	m->vertex_count = uint(vertices.size());
+	m->index_count = uint(indices.size());
+	m->bounds.update( vertices.data(), vertices.size() );
+	return true;
+}
+
+// a single sphere with host copies in vertex_list and index_list
+inline mesh* create_sphere_mesh( uint n_long=72, uint n_lat=36 )
+{
+	if(n_long<3||n_lat<2){ printf( "%s(): %u x %u is too coarse for a sphere\n", __func__, n_long, n_lat ); return nullptr; }
+	mesh* m = new mesh();
+	m->vertex_list.resize( sphere_vertex_count(n_long,n_lat) );	sphere_vertices( n_long, n_lat, m->vertex_list.data() );
+	m->index_list.resize( sphere_index_count(n_long,n_lat) );	sphere_indices( n_long, n_lat, m->index_list.data() );
+	if(!sphere_upload( m, m->vertex_list, m->index_list )){ delete m; return nullptr; }
+	return m;
+}
+
+//*************************************
+// chain of levels of detail in a single vertex/index buffer
+// switching levels only changes the range of indices to draw, without allocations or buffer bindings
+struct sphere_lod
+{
+	uint	n_long, n_lat;
+	size_t	first_index;	// offset into the index buffer
+	uint	index_count;
+};
+
+struct sphere_lod_chain
+{
+	mesh*					p_mesh = nullptr;	// all the levels without host copies
+	std::vector<sphere_lod>	levels;				// coarse to fine
+
+	// the coarsest level whose longitudinal edges are not longer than edge_pixels on the screen
+	uint select( float radius_pixels, float edge_pixels=8.0f ) const
+	{
+		uint k=0; while(k+1<levels.size() && 2.0f*PI*radius_pixels/levels[k].n_long > edge_pixels) k++;
+		return k;
+	}
+	void draw( uint level ) const
+	{
+		const sphere_lod& l = levels[std::min(level,uint(levels.size()-1))];
+		glDrawElements( GL_TRIANGLES, GLsizei(l.index_count), GL_UNSIGNED_INT, (GLvoid*)(sizeof(uint)*l.first_index) );
+	}
+};
+
+// levels double longitudes and latitudes from n_long x n_lat: e.g., 16 x 8 up to 1024 x 512 for 7 levels
+inline sphere_lod_chain create_sphere_lod_chain( uint n_long=16, uint n_lat=8, uint level_count=7 )
+{
+	sphere_lod_chain c;
+	if(n_long<3||n_lat<2||!level_count){ printf( "%s(): %u x %u is too coarse for a sphere\n", __func__, n_long, n_lat ); return c; }
+
+	// presize once, and then write all the levels in place
+	size_t vn=0, in=0;
+	for( uint k=0; k < level_count; k++ ){ vn += sphere_vertex_count(n_long<<k,n_lat<<k); in += sphere_index_count(n_long<<k,n_lat<<k); }
+	std::vector<vertex> vertices(vn); std::vector<uint> indices(in);
+
+	vn=0; in=0;
+	for( uint k=0; k < level_count; k++ )
+	{
+		uint lo=n_long<<k, la=n_lat<<k;
+		sphere_vertices( lo, la, &vertices[vn] );
+		sphere_indices( lo, la, &indices[in], uint(vn) );
+		c.levels.push_back( { lo, la, in, uint(sphere_index_count(lo,la)) } );
+		vn += sphere_vertex_count(lo,la); in += sphere_index_count(lo,la);
+	}
+
+	printf( "> sphere: %u levels from %u x %u to %u x %u, %zu vertices, %zu indices\n", level_count, n_long, n_lat, n_long<<(level_count-1), n_lat<<(level_count-1), vn, in );
+
+	c.p_mesh = new mesh();
+	if(!sphere_upload( c.p_mesh, vertices, indices )){ delete c.p_mesh; c.p_mesh = nullptr; c.levels.clear(); }
+	return c;
+}
+
+//*************************************
+// generators of the same interface: uv sphere, subdivided icosahedron, and normalized cube
+// the uv sphere crowds slivers at the poles, whereas the others spread triangles evenly over the sphere
+enum sphere_type { SPHERE_UV, SPHERE_ICO, SPHERE_CUBE };
+inline const char* sphere_type_name( sphere_type type ){ return type==SPHERE_ICO ? "icosphere" : type==SPHERE_CUBE ? "cube sphere" : "uv sphere"; }
+
+struct sphere_stats_t
+{
+	size_t	vertex_count = 0;
+	size_t	triangle_count = 0;
+	double	msec = 0;			// generation time in milliseconds
+};
+
+// emits triangles of points on the unit sphere, and welds vertices of the same position and texture coordinates;
+// so faces of the base solid share their edges, while vertices on the texture seam and poles are kept apart
+struct sphere_welder
+{
+	struct key_t { int q[5]; bool operator==( const key_t& k ) const { return memcmp(q,k.q,sizeof(q))==0; } };
+	struct hash_t { size_t operator()( const key_t& k ) const { uint64_t h=14695981039346656037ull; for( int x : k.q ){ h^=uint32_t(x); h*=1099511628211ull; } return size_t(h); } };
+
+	std::vector<vertex>&	vertices;
+	std::vector<uint>&		indices;
+	std::unordered_map<key_t,uint,hash_t> map;
+
+	sphere_welder( std::vector<vertex>& v, std::vector<uint>& i ):vertices(v),indices(i){}
+	uint weld( const vec3& p, const vec2& t ) // quantized below the precision of normalize()
+	{
+		key_t k = {{ int(lroundf(p.x*1048576.0f)), int(lroundf(p.y*1048576.0f)), int(lroundf(p.z*1048576.0f)), int(lroundf(t.x*65536.0f)), int(lroundf(t.y*65536.0f)) }};
+		auto it = map.find(k); if(it!=map.end()) return it->second;
+		vertex v; v.pos = v.norm = p; v.tex = t;
+		vertices.push_back(v); return map[k] = uint(vertices.size()-1);
+	}
+	void triangle( vec3 a, vec3 b, vec3 c )
+	{
+		if(dot(cross(b-a,c-a),a+b+c)<0) std::swap(b,c); // counter-clockwise seen from outside
+		vec3 p[3] = { a, b, c }; vec2 t[3]; int pole=-1; float umax=0;
+		for( int k=0; k < 3; k++ )
+		{
+			float phi = atan2f(p[k].y,p[k].x); if(phi<0) phi += 2.0f*PI;
+			t[k] = vec2( phi/(2.0f*PI), 1.0f-acosf(std::max(-1.0f,std::min(1.0f,p[k].z)))/PI ); // the same T(x,y) as the uv sphere
+			if(p[k].x*p[k].x+p[k].y*p[k].y<1e-10f) pole=k; else umax=std::max(umax,t[k].x);
+		}
+		for( int k=0; k < 3; k++ ) if(k!=pole&&umax-t[k].x>0.5f) t[k].x += 1.0f;	// crossing the seam: wrap beyond 1
+		if(pole>=0) t[pole].x = (t[(pole+1)%3].x+t[(pole+2)%3].x)*0.5f;					// undefined at the poles: the middle of the others
+		for( int k=0; k < 3; k++ ) indices.push_back( weld(p[k],t[k]) );
+	}
+};
+
+// n_lat=detail latitudes and n_long=2*detail longitudes
+inline void sphere_uv( uint detail, std::vector<vertex>& vertices, std::vector<uint>& indices )
+{
+	vertices.resize( sphere_vertex_count(detail*2,detail) );	sphere_vertices( detail*2, detail, vertices.data() );
+	indices.resize( sphere_index_count(detail*2,detail) );		sphere_indices( detail*2, detail, indices.data() );
+}
+
+// each face of the icosahedron is split into detail^2 triangles; vertices at the poles and two rings of five
+inline void sphere_ico( uint detail, std::vector<vertex>& vertices, std::vector<uint>& indices )
+{
+	vec3 top(0,0,1), bottom(0,0,-1), upper[5], lower[5];
+	for( int k=0; k < 5; k++ )
+	{
+		float a=2.0f*PI*k/5.0f, b=a+PI/5.0f, h=1.0f/sqrtf(5.0f), r=2.0f*h;
+		upper[k] = vec3( r*cosf(a), r*sinf(a), h ); lower[k] = vec3( r*cosf(b), r*sinf(b), -h );
+	}
+
+	sphere_welder w( vertices, indices ); float n=float(detail);
+	vertices.reserve( 10*detail*detail+2 ); indices.reserve( 60*detail*detail ); w.map.reserve( vertices.capacity() );
+	auto face = [&]( vec3 a, vec3 b, vec3 c )
+	{
+		auto P = [&]( uint i, uint j ){ return normalize( a+(b-a)*(i/n)+(c-a)*(j/n) ); };
+		for( uint i=0; i < detail; i++ ) for( uint j=0; i+j < detail; j++ )
+		{
+			w.triangle( P(i,j), P(i+1,j), P(i,j+1) );
+			if(i+j+1<detail) w.triangle( P(i+1,j), P(i+1,j+1), P(i,j+1) );
+		}
+	};
+	for( int k=0; k < 5; k++ )
+	{
+		int l=(k+1)%5;
+		face( top, upper[k], upper[l] );
+		face( upper[k], lower[k], upper[l] );
+		face( upper[l], lower[k], lower[l] );
+		face( bottom, lower[l], lower[k] );
+	}
+}
+
+// each face of the cube is split into detail^2 quads; equal-angle spacing (tan) keeps cells of similar sizes after normalization
+inline void sphere_cube( uint detail, std::vector<vertex>& vertices, std::vector<uint>& indices )
+{
+	sphere_welder w( vertices, indices ); float n=float(detail);
+	vertices.reserve( 6*(detail+1)*(detail+1) ); indices.reserve( 36*detail*detail ); w.map.reserve( vertices.capacity() );
+	std::vector<float> s(detail+1); for( uint i=0; i <= detail; i++ ) s[i] = tanf( PI*0.25f*(2.0f*i/n-1.0f) );
+	for( int f=0; f < 6; f++ )
+	{
+		vec3 e[3] = { vec3(1,0,0), vec3(0,1,0), vec3(0,0,1) };
+		vec3 c = e[f%3]*(f<3?1.0f:-1.0f), u = e[(f+1)%3], v = e[(f+2)%3];
+		auto P = [&]( uint i, uint j ){ return normalize( c+u*s[i]+v*s[j] ); };
+		for( uint i=0; i < detail; i++ ) for( uint j=0; j < detail; j++ )
+		{
+			w.triangle( P(i,j), P(i+1,j), P(i+1,j+1) );
+			w.triangle( P(i,j), P(i+1,j+1), P(i,j+1) );
+		}
+	}
+}
+
+inline sphere_stats_t sphere_generate( sphere_type type, uint detail, std::vector<vertex>& vertices, std::vector<uint>& indices )
+{
+	sphere_stats_t stats; vertices.clear(); indices.clear();
+	if(detail<(type==SPHERE_UV?2u:1u)){ printf( "%s(): detail %u is too coarse for a %s\n", __func__, detail, sphere_type_name(type) ); return stats; }
+
+	auto t0 = std::chrono::steady_clock::now();
+	if(type==SPHERE_ICO)		sphere_ico( detail, vertices, indices );
+	else if(type==SPHERE_CUBE)	sphere_cube( detail, vertices, indices );
+	else						sphere_uv( detail, vertices, indices );
+	stats.msec = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t0).count();
+	stats.vertex_count = vertices.size();
+	stats.triangle_count = indices.size()/3;
+	return stats;
+}
+
+// detail of a generator whose edges are as long as the equatorial edges of the uv sphere of uv_detail:
+// PI/uv_detail for the uv sphere, 1.107/detail for the icosphere, and PI/2/detail for the cube sphere
+inline uint sphere_matched_detail( sphere_type type, uint uv_detail )
+{
+	if(type==SPHERE_ICO) return std::max(1u,uint(lroundf(uv_detail*1.107f/PI)));
+	if(type==SPHERE_CUBE) return std::max(1u,(uv_detail+1)/2);
+	return uv_detail;
+}
+
+// counts and generation times of the three generators at matched edge lengths
+inline void sphere_report( uint uv_detail=36 )
+{
+	std::vector<vertex> vertices; std::vector<uint> indices;
+	printf( "> sphere generators at the edge length of %u x %u:\n", uv_detail*2, uv_detail );
+	for( sphere_type type : { SPHERE_UV, SPHERE_ICO, SPHERE_CUBE } )
+	{
+		uint detail = sphere_matched_detail( type, uv_detail );
+		sphere_stats_t s = sphere_generate( type, detail, vertices, indices );
+		printf( "  %-12s detail %3u: %7zu vertices, %7zu triangles, %.3f ms\n", sphere_type_name(type), detail, s.vertex_count, s.triangle_count, s.msec );
+	}
+}
+
+// a single sphere of any generator with host copies in vertex_list and index_list
+inline mesh* create_sphere_mesh( sphere_type type, uint detail )
+{
+	mesh* m = new mesh();
+	sphere_stats_t stats = sphere_generate( type, detail, m->vertex_list, m->index_list );
+	if(!stats.triangle_count||!sphere_upload( m, m->vertex_list, m->index_list )){ delete m; return nullptr; }
+	return m;
+}
+
+#endif
\ No newline at end of file
@@ -3,19 +3,39 @@ layout(location=0) in vec3 position;
 layout(location=1) in vec3 normal;
 layout(location=2) in vec2 texcoord;
 
+// per-instance model matrix for instanced rendering
+layout(location=3) in mat4 instance_matrix;
+
 // matrices
 uniform mat4 model_matrix;
 uniform mat4 view_matrix;
 uniform mat4 projection_matrix;
+uniform bool b_instanced;	// use instance_matrix instead of model_matrix
+
+// dequantization of packed vertices: unorm16 positions in the AABB and octahedral normals
+uniform bool b_packed;
+uniform vec3 pos_offset;
+uniform vec3 pos_scale;
 
 out vec3 norm;
 
+vec3 oct_decode( vec2 e )
+{
+	vec3 n = vec3( e, 1.0-abs(e.x)-abs(e.y) );
+	if(n.z<0.0) n.xy = (1.0-abs(n.yx))*mix(vec2(-1.0),vec2(1.0),greaterThanEqual(n.xy,vec2(0.0)));
+	return n;
+}
+
 void main()
 {
-	vec4 wpos = model_matrix * vec4(position,1);
+	vec3 p = b_packed ? pos_offset+pos_scale*position : position;
+	vec3 n = b_packed ? oct_decode(normal.xy) : normal;
+
+	mat4 m = b_instanced ? instance_matrix : model_matrix;
+	vec4 wpos = m * vec4(p,1);
 	vec4 epos = view_matrix * wpos;
 	gl_Position = projection_matrix * epos;
 
 	// pass eye-coordinate normal to fragment shader
-	norm = normalize(mat3(view_matrix*model_matrix)*normal);
+	norm = normalize(mat3(view_matrix*m)*n);
 }
@@ -0,0 +1,158 @@
+#pragma once
+#ifndef __CGASYNC_H__
+#define __CGASYNC_H__
+
+#include "cgut.h"
+#include "cgpack.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//*************************************
+// future-like handle of an asset loaded in background
+enum class load_status { pending, ready, failed };
+
+template <class T> struct cg_handle
+{
+	struct state_t { std::atomic<load_status> status{load_status::pending}; T value{}; };
+	std::shared_ptr<state_t> state = std::make_shared<state_t>();
+
+	load_status status() const { return state->status.load(std::memory_order_acquire); }
+	bool	ready() const { return status()==load_status::ready; }
+	bool	failed() const { return status()==load_status::failed; }
+	T		get() const { return ready()?state->value:T(); } // null until ready
+	void	set( T v ) const { state->value = v; state->status.store(v?load_status::ready:load_status::failed,std::memory_order_release); }
+};
+
+//*************************************
+// background asset loader
+// worker threads read and decode files into CPU-side staging, and the main thread
+// drains the completion queue by poll() once per frame to run the GL uploads
+struct cg_async_loader
+{
+	std::vector<std::thread>			threads;
+	std::mutex							mtx;
+	std::condition_variable				cv;
+	std::deque<std::function<void()>>	jobs;		// file I/O and decoding in worker threads
+	std::deque<std::function<void()>>	uploads;	// GL calls in the main thread
+	uint								in_flight = 0;	// number of jobs not uploaded yet
+	bool								b_quit = false;
+
+	static cg_async_loader& instance(){ static cg_async_loader i; return i; }
+	cg_async_loader( uint count=2 );
+	~cg_async_loader();
+
+	cg_handle<mesh*>	load_mesh( const char* vert_binary_path, const char* index_binary_path, uint flags=0 ); // flags of cg_load_mesh()
+	cg_handle<mesh*>	load_mesh_pack( const char* pack_path );
+#if defined(STBI_INCLUDE_STB_IMAGE_H)||defined(STBI_VERSION)
+	cg_handle<GLuint>	load_texture( const char* image_path, bool mipmap=true, GLenum wrap=GL_CLAMP_TO_EDGE, GLenum filter=GL_LINEAR );
+#endif
+	uint	poll( uint max_uploads=~0u );	// call in the main thread; returns the number of uploads
+	bool	busy(){ std::lock_guard<std::mutex> lock(mtx); return in_flight>0; }
+
+protected:
+	void	push( std::function<void()> job );
+	void	complete( std::function<void()> upload ){ std::lock_guard<std::mutex> lock(mtx); uploads.emplace_back(std::move(upload)); }
+};
+
+inline cg_async_loader::cg_async_loader( uint count )
+{
+	for( uint k=0; k < count; k++ ) threads.emplace_back( [this]()
+	{
+		for(;;)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait( lock, [&](){ return b_quit||!jobs.empty(); } );
+			if(b_quit) return;
+			auto job = std::move(jobs.front()); jobs.pop_front(); lock.unlock();
+			job();
+		}
+	});
+}
+
+inline cg_async_loader::~cg_async_loader()
+{
+	{ std::lock_guard<std::mutex> lock(mtx); b_quit = true; }
+	cv.notify_all();
+	for( auto& t : threads ) t.join();
+	// pending uploads are discarded without GL calls, since the context may be gone at exit;
+	// destroying them frees their staging (mapped files, decoded images) without uploading it
+}
+
+inline void cg_async_loader::push( std::function<void()> job )
+{
+	{ std::lock_guard<std::mutex> lock(mtx); jobs.emplace_back(std::move(job)); in_flight++; }
+	cv.notify_one();
+}
+
+inline uint cg_async_loader::poll( uint max_uploads )
+{
+	uint count=0;
+	for( ; count < max_uploads; count++ )
+	{
+		std::function<void()> upload;
+		{
+			std::lock_guard<std::mutex> lock(mtx); if(uploads.empty()) break;
+			upload = std::move(uploads.front()); uploads.pop_front(); in_flight--;
+		}
+		upload();
+	}
+	return count;
+}
+
+inline cg_handle<mesh*> cg_async_loader::load_mesh( const char* vert_binary_path, const char* index_binary_path, uint flags )
+{
+	cg_handle<mesh*> h;
+	push( [this,h,vpath=std::string(vert_binary_path),ipath=std::string(index_binary_path),flags]()
+	{
+		// mapping, optimization and packing run here; prefault the mapped pages that the upload reads,
+		// so that it does not stall the main thread on disk reads
+		auto s = std::make_shared<mesh_staging>();
+		bool b = cg_stage_mesh( vpath.c_str(), ipath.c_str(), flags, *s );
+		if(b){ volatile char sum=0; for( auto* m : {&s->v,&s->i} ) for( size_t k=0; k < m->size; k+=4096 ) sum = sum+m->ptr[k]; }
+		complete( [h,s,b](){ h.set( b ? cg_upload_mesh( *s ) : nullptr ); } );
+	});
+	return h;
+}
+
+inline cg_handle<mesh*> cg_async_loader::load_mesh_pack( const char* pack_path )
+{
+	cg_handle<mesh*> h;
+	push( [this,h,path=std::string(pack_path)]()
+	{
+		// map, validate and prefault the file here; the payload is decoded into mapped GL buffers in the upload
+		auto m = std::make_shared<mapped_t>(); const char* p = absolute_path(path.c_str());
+		mesh_pack_header header; bool b = m->map(p)&&m->size>=sizeof(header);
+		if(b){ memcpy( (void*) &header, m->ptr, sizeof(header) ); b = cg_validate_pack_header( header, p ); }
+		else printf( "%s(): unable to map %s\n", __func__, p );
+		if(b){ volatile char sum=0; for( size_t k=0; k < m->size; k+=4096 ) sum = sum+m->ptr[k]; }
+
+		complete( [h,m,header,b,path]()
+		{
+			size_t offset = sizeof(header);
+			auto next_chunk = [&]( const uchar*& chunk ){ chunk=(const uchar*)m->ptr+offset; size_t n=m->size-offset; offset=m->size; return n; };
+			h.set( b ? cg_decode_mesh_pack( header, next_chunk, path.c_str() ) : nullptr );
+		});
+	});
+	return h;
+}
+
+#if defined(STBI_INCLUDE_STB_IMAGE_H)||defined(STBI_VERSION)
+inline cg_handle<GLuint> cg_async_loader::load_texture( const char* image_path, bool mipmap, GLenum wrap, GLenum filter )
+{
+	cg_handle<GLuint> h;
+	push( [this,h,path=std::string(image_path),mipmap,wrap,filter]()
+	{
+		// decoding and vertical flip in a worker; the image is owned by the upload, and freed with it if discarded
+		auto i = std::make_shared<std::unique_ptr<image>>( cg_load_image( path.c_str() ) );
+		complete( [h,i,mipmap,wrap,filter](){ h.set( cg_create_texture( i->release(), mipmap, wrap, filter ) ); } ); // cg_create_texture() releases the image
+	});
+	return h;
+}
+#endif
+
+#endif // __CGASYNC_H__
\ No newline at end of file
@@ -0,0 +1,246 @@
+#pragma once
+#ifndef __CGPACK_H__
+#define __CGPACK_H__
+
+#include "cgut.h"
+#include <functional>
+
+//*************************************
+// single-file mesh container (*.pack.bin)
+// [mesh_pack_header][vertex payload][index payload]
+// payloads are raw or encoded as zigzag-delta varints: 16-bit lanes of vertices and 32-bit indices,
+// which compress well after cg_optimize_mesh() due to the locality of vertices and indices
+#define CGMP_MAGIC		0x504d4743 // "CGMP" in little endian
+#define CGMP_VERSION	1
+
+enum mesh_pack_layout : uint { PACK_LAYOUT_VERTEX=0, PACK_LAYOUT_PACKED=1 };		// struct vertex or packed_vertex
+enum mesh_pack_encoding : uint { PACK_ENCODING_RAW=0, PACK_ENCODING_DELTA=1 };
+
+struct mesh_pack_attrib { uint location, components, type, normalized, offset; }; // arguments of glVertexAttribPointer()
+
+struct mesh_pack_header
+{
+	uint				magic = CGMP_MAGIC;
+	uint				version = CGMP_VERSION;
+	uint				header_size = sizeof(mesh_pack_header);
+	uint				layout = PACK_LAYOUT_PACKED;
+	uint				encoding = PACK_ENCODING_DELTA;
+	uint				vertex_count = 0;
+	uint				index_count = 0;
+	uint				vertex_stride = 0;
+	uint				attrib_count = 0;
+	mesh_pack_attrib	attrib[3] = {};	// vertex layout descriptor
+	vec3				aabb_min, aabb_max;
+	uint				checksum = 0;	// FNV-1a of the payloads
+	uint				reserved = 0;
+	uint64_t			vertex_bytes = 0, index_bytes = 0; // payload sizes in the file
+};
+static_assert( sizeof(mesh_pack_header)==144, "mesh_pack_header should be 144 bytes" );
+
+inline uint cg_fnv1a( const void* ptr, size_t size, uint h=2166136261u )
+{
+	for( const uchar *p=(const uchar*)ptr, *e=p+size; p<e; p++ ){ h^=*p; h*=16777619u; }
+	return h;
+}
+
+// vertex layout descriptors of struct vertex and packed_vertex
+inline void cg_pack_layout( mesh_pack_header& h, uint layout )
+{
+	h.layout = layout; h.attrib_count = 3;
+	if(layout==PACK_LAYOUT_PACKED)
+	{
+		h.vertex_stride = sizeof(packed_vertex);
+		h.attrib[0] = { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, uint(offsetof(packed_vertex,pos)) };
+		h.attrib[1] = { 1, 2, GL_SHORT, GL_TRUE, uint(offsetof(packed_vertex,norm)) };
+		h.attrib[2] = { 2, 2, GL_HALF_FLOAT, GL_FALSE, uint(offsetof(packed_vertex,tex)) };
+	}
+	else
+	{
+		h.vertex_stride = sizeof(vertex);
+		h.attrib[0] = { 0, 3, GL_FLOAT, GL_FALSE, uint(offsetof(vertex,pos)) };
+		h.attrib[1] = { 1, 3, GL_FLOAT, GL_FALSE, uint(offsetof(vertex,norm)) };
+		h.attrib[2] = { 2, 2, GL_FLOAT, GL_FALSE, uint(offsetof(vertex,tex)) };
+	}
+}
+
+inline bool cg_validate_pack_header( const mesh_pack_header& h, const char* name )
+{
+	const char* e = nullptr;
+	if(h.magic!=CGMP_MAGIC)											e = "not a mesh pack file";
+	else if(h.version!=CGMP_VERSION||h.header_size!=sizeof(h))		e = "unsupported version";
+	else if(h.layout>PACK_LAYOUT_PACKED||h.encoding>PACK_ENCODING_DELTA)	e = "unknown layout or encoding";
+	else if(!h.vertex_count||!h.index_count||h.index_count%3)		e = "invalid vertex/index counts";
+	else if(h.vertex_stride%2||h.vertex_stride>64||h.attrib_count>3)	e = "invalid vertex layout";
+	else if(!h.vertex_bytes||!h.index_bytes)						e = "empty payloads";
+	else if(h.encoding==PACK_ENCODING_RAW&&(h.vertex_bytes!=uint64_t(h.vertex_count)*h.vertex_stride||h.index_bytes!=uint64_t(h.index_count)*sizeof(uint))) e = "invalid payload sizes";
+	for( uint k=0; !e&&k < h.attrib_count; k++ ) if(h.attrib[k].location>15||h.attrib[k].offset>=h.vertex_stride||h.attrib[k].components-1>3) e = "invalid vertex attribute";
+	if(e) printf( "%s(): %s: %s\n", __func__, name, e );
+	return e==nullptr;
+}
+
+//*************************************
+// encoder
+inline void cg_put_varint( std::vector<uchar>& out, uint v ){ for( ; v>=0x80; v>>=7 ) out.push_back(uchar(v|0x80)); out.push_back(uchar(v)); }
+
+inline std::vector<uchar> cg_encode_vertices( const void* vertices, size_t vertex_count, uint stride )
+{
+	std::vector<uchar> out; out.reserve(vertex_count*stride/2);
+	uint lanes = stride/2; std::vector<ushort> prev(lanes,0);
+	for( size_t k=0; k < vertex_count; k++ ) for( uint l=0; l < lanes; l++ )
+	{
+		ushort w; memcpy( &w, (const uchar*)vertices+k*stride+l*2, 2 );
+		short d = short(ushort(w-prev[l])); prev[l] = w;
+		cg_put_varint( out, uint(ushort((d<<1)^(d>>15))) ); // zigzag
+	}
+	return out;
+}
+
+inline std::vector<uchar> cg_encode_indices( const uint* indices, size_t index_count )
+{
+	std::vector<uchar> out; out.reserve(index_count*2);
+	for( size_t k=0, prev=0; k < index_count; prev=indices[k], k++ )
+	{
+		int d = int(indices[k]-uint(prev));
+		cg_put_varint( out, uint(d<<1)^uint(d>>31) ); // zigzag
+	}
+	return out;
+}
+
+// vertices are struct vertex or packed_vertex as given by layout; for packed_vertex,
+// AABB should be the same as the quantization box (see cg_pack_vertices())
+inline bool cg_save_mesh_pack( const char* pack_path, const void* vertices, size_t vertex_count, uint layout, const uint* indices, size_t index_count, vec3 aabb_min, vec3 aabb_max, uint encoding=PACK_ENCODING_DELTA )
+{
+	mesh_pack_header h; cg_pack_layout( h, layout );
+	h.encoding = encoding; h.vertex_count = uint(vertex_count); h.index_count = uint(index_count);
+	h.aabb_min = aabb_min; h.aabb_max = aabb_max;
+
+	std::vector<uchar> v, i;
+	if(encoding==PACK_ENCODING_DELTA){ v = cg_encode_vertices( vertices, vertex_count, h.vertex_stride ); i = cg_encode_indices( indices, index_count ); }
+	else { v.assign( (const uchar*) vertices, (const uchar*) vertices+vertex_count*h.vertex_stride ); i.assign( (const uchar*) indices, (const uchar*)(indices+index_count) ); }
+	h.vertex_bytes = v.size(); h.index_bytes = i.size();
+	h.checksum = cg_fnv1a( i.data(), i.size(), cg_fnv1a( v.data(), v.size() ) );
+
+	FILE* fp = fopen( pack_path, "wb" ); if(!fp){ printf( "%s(): unable to open %s\n", __func__, pack_path ); return false; }
+	bool b = fwrite(&h,sizeof(h),1,fp)==1 && fwrite(v.data(),1,v.size(),fp)==v.size() && fwrite(i.data(),1,i.size(),fp)==i.size();
+	fclose(fp); if(!b) printf( "%s(): failed to write %s\n", __func__, pack_path );
+	return b;
+}
+
+//*************************************
+// streaming decoder: payload chunks of any size are fed in the file order,
+// and vertices/indices are written directly to the destinations (e.g., mapped GL buffers)
+struct mesh_pack_decoder
+{
+	const mesh_pack_header&	h;
+	uchar*				dst[2];				// vertices and indices
+	uint64_t			stream_bytes[2];	// payload sizes of the two streams
+	size_t				value_count[2];		// number of 16-bit lanes and 32-bit indices
+	uint				hash = 2166136261u;
+	int					stream = 0;			// 0: vertices, 1: indices, 2: done
+	uint64_t			consumed = 0;		// bytes consumed in the current stream
+	size_t				k = 0;				// values decoded in the current stream
+	uint				acc=0, shift=0;		// partial varint
+	uint				prev_index = 0, max_index = 0;
+	std::vector<ushort>	prev_lane;
+
+	mesh_pack_decoder( const mesh_pack_header& header, void* vertices, uint* indices ) : h(header), dst{(uchar*)vertices,(uchar*)indices}, stream_bytes{header.vertex_bytes,header.index_bytes},
+		value_count{size_t(header.vertex_count)*header.vertex_stride/2,header.index_count}, prev_lane(header.vertex_stride/2,0){ skip_empty(); }
+	bool	done() const { return stream==2; }
+	bool	valid() const { return done()&&hash==h.checksum&&max_index<h.vertex_count; }
+	bool	feed( const uchar* in, size_t n ); // false on corrupted data
+	void	skip_empty(){ while(stream<2&&stream_bytes[stream]==0) stream++; }
+};
+
+inline bool mesh_pack_decoder::feed( const uchar* in, size_t n )
+{
+	hash = cg_fnv1a( in, n, hash );
+	while( n && stream<2 )
+	{
+		size_t m = size_t(std::min(uint64_t(n),stream_bytes[stream]-consumed)); // bytes in the current stream
+		if(h.encoding==PACK_ENCODING_RAW)
+		{
+			memcpy( dst[stream]+consumed, in, m );
+			if(stream==1) for( size_t j=0; j < m; j++ ) // track the max index without reading back the destination
+			{
+				uint b=uint((consumed+j)&3); acc |= uint(in[j])<<(8*b);
+				if(b==3){ max_index=std::max(max_index,acc); acc=0; }
+			}
+		}
+		else for( size_t j=0; j < m; j++ )
+		{
+			acc |= uint(in[j]&0x7f)<<shift; shift+=7;
+			if(in[j]&0x80){ if(shift>28) return false; continue; }
+			if(k>=value_count[stream]) return false;
+			uint v=acc; acc=shift=0;
+			if(stream==0){ ushort& p=prev_lane[k%prev_lane.size()]; p=ushort(p+ushort((v>>1)^(0u-(v&1)))); memcpy( dst[0]+k*2, &p, 2 ); }
+			else { prev_index += (v>>1)^(0u-(v&1)); max_index=std::max(max_index,prev_index); memcpy( dst[1]+k*4, &prev_index, 4 ); }
+			k++;
+		}
+		in+=m; n-=m; consumed+=m;
+		if(consumed==stream_bytes[stream])
+		{
+			if(h.encoding==PACK_ENCODING_DELTA&&(k!=value_count[stream]||shift)) return false;
+			stream++; consumed=0; k=0; skip_empty();
+		}
+	}
+	return n==0;
+}
+
+// decode a pack payload directly into mapped GL buffers; next_chunk() returns the next payload chunk, or 0 at the end
+inline mesh* cg_decode_mesh_pack( const mesh_pack_header& h, std::function<size_t(const uchar*&)> next_chunk, const char* name )
+{
+	mesh* new_mesh = new mesh();
+	new_mesh->vertex_count = h.vertex_count;
+	new_mesh->index_count = h.index_count;
+	new_mesh->b_packed = h.layout==PACK_LAYOUT_PACKED;
+	new_mesh->quant.offset = h.aabb_min; for( int d=0; d < 3; d++ ) new_mesh->quant.scale[d] = h.aabb_max[d]>h.aabb_min[d]?h.aabb_max[d]-h.aabb_min[d]:1.0f;
+	new_mesh->bounds.set_box( h.aabb_min, h.aabb_max );
+
+	// allocate buffers and map them for writing; GL_COPY_WRITE_BUFFER avoids touching the element binding of VAOs
+	GLsizeiptr vsize=GLsizeiptr(h.vertex_count)*h.vertex_stride, isize=GLsizeiptr(h.index_count)*sizeof(uint);
+	glGenBuffers( 1, &new_mesh->vertex_buffer );
+	glBindBuffer( GL_ARRAY_BUFFER, new_mesh->vertex_buffer );
+	glBufferData( GL_ARRAY_BUFFER, vsize, nullptr, GL_STATIC_DRAW );
+	glGenBuffers( 1, &new_mesh->index_buffer );
+	glBindBuffer( GL_COPY_WRITE_BUFFER, new_mesh->index_buffer );
+	glBufferData( GL_COPY_WRITE_BUFFER, isize, nullptr, GL_STATIC_DRAW );
+	void* v = glMapBufferRange( GL_ARRAY_BUFFER, 0, vsize, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT );
+	void* i = glMapBufferRange( GL_COPY_WRITE_BUFFER, 0, isize, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT );
+
+	bool b = v&&i;
+	if(b){ mesh_pack_decoder d( h, v, (uint*) i ); const uchar* chunk; for( size_t n; b&&(n=next_chunk(chunk)); ) b = d.feed( chunk, n ); b = b&&d.valid(); }
+	if(v&&!glUnmapBuffer( GL_ARRAY_BUFFER )) b = false; // contents may be lost
+	if(i&&!glUnmapBuffer( GL_COPY_WRITE_BUFFER )) b = false;
+	if(!b){ printf( "%s(): %s is corrupted\n", __func__, name ); delete new_mesh; return nullptr; }
+
+	// generate vertex array object by the layout descriptor
+	glGenVertexArrays( 1, &new_mesh->vertex_array );
+	glBindVertexArray( new_mesh->vertex_array );
+	glBindBuffer( GL_ARRAY_BUFFER, new_mesh->vertex_buffer );
+	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, new_mesh->index_buffer );
+	for( uint k=0; k < h.attrib_count; k++ )
+	{
+		const mesh_pack_attrib& a = h.attrib[k];
+		glEnableVertexAttribArray( a.location );
+		glVertexAttribPointer( a.location, GLint(a.components), GLenum(a.type), GLboolean(a.normalized), GLsizei(h.vertex_stride), (GLvoid*) size_t(a.offset) );
+	}
+	glBindVertexArray( 0 );
+
+	return new_mesh;
+}
+
+// read the pack file in chunks and stream them into GL buffers
+inline mesh* cg_load_mesh_pack( const char* pack_path )
+{
+	pack_path = absolute_path(pack_path);
+	FILE* fp = fopen( pack_path, "rb" ); if(!fp){ printf( "%s(): unable to open %s\n", __func__, pack_path ); return nullptr; }
+	mesh_pack_header h;
+	if(fread(&h,sizeof(h),1,fp)!=1||!cg_validate_pack_header( h, pack_path )){ fclose(fp); return nullptr; }
+
+	std::vector<uchar> buffer(1<<16);
+	mesh* new_mesh = cg_decode_mesh_pack( h, [&]( const uchar*& chunk ){ chunk=buffer.data(); return fread( buffer.data(), 1, buffer.size(), fp ); }, pack_path );
+	fclose(fp);
+	return new_mesh;
+}
+
+#endif // __CGPACK_H__
\ No newline at end of file
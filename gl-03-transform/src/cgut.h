@@ -58,11 +58,39 @@
 	#endif
 	#include <direct.h>
 	#include <io.h>
+	#ifndef MAX_PATH
+		static const int MAX_PATH = _MAX_PATH; // same as <windows.h>, which is not included here
+	#endif
 	// suppress warning for deprecated posix access
 	#define access _access
 	#define strdup _strdup
 #endif
 
+// memory-mapped files: on Windows, only the kernel32 functions of mapped_t and module_t are declared with the same types
+// as <windows.h>, instead of including all of <windows.h> and its macros into every translation unit
+#if defined(_WIN32)
+	struct _SECURITY_ATTRIBUTES;
+	union _LARGE_INTEGER;
+	extern "C"
+	{
+		__declspec(dllimport) void* __stdcall CreateFileA( const char*, unsigned long, unsigned long, _SECURITY_ATTRIBUTES*, unsigned long, unsigned long, void* );
+		__declspec(dllimport) int __stdcall GetFileSizeEx( void*, _LARGE_INTEGER* );
+		__declspec(dllimport) void* __stdcall CreateFileMappingA( void*, _SECURITY_ATTRIBUTES*, unsigned long, unsigned long, unsigned long, const char* );
+	#if defined(_WIN64)
+		__declspec(dllimport) void* __stdcall MapViewOfFile( void*, unsigned long, unsigned long, unsigned long, unsigned long long );
+	#else
+		__declspec(dllimport) void* __stdcall MapViewOfFile( void*, unsigned long, unsigned long, unsigned long, unsigned long );
+	#endif
+		__declspec(dllimport) int __stdcall UnmapViewOfFile( const void* );
+		__declspec(dllimport) int __stdcall CloseHandle( void* );
+		__declspec(dllimport) unsigned long __stdcall GetTempPathA( unsigned long, char* );
+	}
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
 #if defined(__has_include)
 	// GLFW
 	#define GLFW_INCLUDE_NONE
@@ -187,10 +215,10 @@ inline const char* absolute_path( const char* file_path )
 	if(strchr(file_path,':')) return file_path; // is already absolute path
 	char t[MAX_PATH]; sprintf_s( t, "%s%s", module_t().dir, file_path ); // build absolute path
 	for(auto& c:t) if(c=='/') c='\\'; // slash to backslash in Windows
-	static char f[MAX_PATH]; return _fullpath( f, t, MAX_PATH ); // canonicalize the path
+	static thread_local char f[MAX_PATH]; return _fullpath( f, t, MAX_PATH ); // canonicalize the path
 #else
 	if(*file_path=='/') return file_path; // is already absolute path
-	static char f[MAX_PATH]; sprintf( f, "%s%s", module_t().dir, file_path ); // build absolute path
+	static thread_local char f[MAX_PATH]; sprintf( f, "%s%s", module_t().dir, file_path ); // build absolute path
 	for(auto& c:f) if(c=='\\') c='/'; // backslash to slash in Linux
 	return f;
 #endif
@@ -204,6 +232,63 @@ struct mem_t
 	size_t	size = 0;
 };
 
+// read-only memory-mapped file: pages are loaded on demand and released at destruction
+struct mapped_t
+{
+	const char*	ptr = nullptr;
+	size_t		size = 0;
+#if defined(_WIN32)
+	void*		file = invalid_handle(), *mapping = nullptr;	// HANDLE
+	static void* invalid_handle(){ return (void*)intptr_t(-1); }	// INVALID_HANDLE_VALUE
+#else
+	int			fd = -1;
+#endif
+
+	mapped_t() = default;
+	mapped_t( const mapped_t& ) = delete;
+	mapped_t& operator=( const mapped_t& ) = delete;
+	~mapped_t(){ unmap(); }
+	operator bool() const { return ptr!=nullptr; }
+
+	inline bool map( const char* file_path );
+	inline void unmap();
+};
+
+inline bool mapped_t::map( const char* file_path )
+{
+	unmap();
+#if defined(_WIN32)
+	const unsigned long generic_read=0x80000000ul, share_read=1, open_existing=3, normal_sequential=0x80|0x08000000ul, page_readonly=2, file_map_read=4; // values of <windows.h>
+	file = CreateFileA( file_path, generic_read, share_read, nullptr, open_existing, normal_sequential, nullptr ); if(file==invalid_handle()) return false;
+	long long s=0; if(!GetFileSizeEx( file, (_LARGE_INTEGER*) &s )||s==0){ unmap(); return false; } // LARGE_INTEGER::QuadPart
+	mapping = CreateFileMappingA( file, nullptr, page_readonly, 0, 0, nullptr ); if(!mapping){ unmap(); return false; }
+	ptr = (const char*) MapViewOfFile( mapping, file_map_read, 0, 0, 0 ); if(!ptr){ unmap(); return false; }
+	size = size_t(s);
+#else
+	fd = open( file_path, O_RDONLY ); if(fd<0) return false;
+	struct stat s; if(fstat( fd, &s )!=0||s.st_size==0){ unmap(); return false; }
+	void* p = mmap( nullptr, size_t(s.st_size), PROT_READ, MAP_PRIVATE, fd, 0 ); if(p==MAP_FAILED){ unmap(); return false; }
+	madvise( p, size_t(s.st_size), MADV_SEQUENTIAL );
+	ptr = (const char*) p; size = size_t(s.st_size);
+#endif
+	return true;
+}
+
+inline void mapped_t::unmap()
+{
+#if defined(_WIN32)
+	if(ptr) UnmapViewOfFile( ptr );
+	if(mapping) CloseHandle( mapping );
+	if(file!=invalid_handle()) CloseHandle( file );
+	file = invalid_handle(); mapping = nullptr;
+#else
+	if(ptr) munmap( (void*) ptr, size );
+	if(fd>=0) close( fd );
+	fd = -1;
+#endif
+	ptr = nullptr; size = 0;
+}
+
 struct vertex // will be used for all the course examples
 {
 	vec3 pos;	// position
@@ -211,6 +296,197 @@ struct vertex // will be used for all the course examples
 	vec2 tex;	// texture coordinate; ignore this for the moment
 };
 
+// 16-byte packed alternative to struct vertex; dequantized in vertex shaders
+struct packed_vertex
+{
+	ushort	pos[4];		// unorm16 position relative to the mesh AABB; pos[3] is padding
+	short	norm[2];	// snorm16 octahedral-encoded normal
+	ushort	tex[2];		// half-float texture coordinate
+};
+
+// dequantization of packed_vertex::pos: position = offset + scale*pos
+struct vertex_quant
+{
+	vec3	offset = vec3(0,0,0);	// AABB minimum
+	vec3	scale = vec3(1,1,1);	// AABB extent
+};
+
+//*************************************
+// vertex packing: half floats, octahedral normals, and AABB-relative unorm16 positions
+inline ushort cg_float_to_half( float f )
+{
+	uint x; memcpy( &x, &f, sizeof(x) );
+	uint sign=(x>>16)&0x8000, e=(x>>23)&0xff, m=x&0x7fffff;
+	if(e==0xff) return ushort(sign|0x7c00|(m?0x200:0));		// inf or nan
+	int he = int(e)-127+15;
+	if(he>=31) return ushort(sign|0x7c00);						// overflow to inf
+	if(he<=0)													// subnormal or zero
+	{
+		if(he<-10) return ushort(sign);
+		uint s=uint(14-he), h=(m|0x800000)>>s, r=(m|0x800000)&((1u<<s)-1), half=1u<<(s-1);
+		return ushort(sign|(h+(r>half||(r==half&&(h&1)))));
+	}
+	uint h=(uint(he)<<10)|(m>>13), r=m&0x1fff;					// round to nearest even; carry may bump the exponent
+	return ushort(sign|(h+(r>0x1000||(r==0x1000&&(h&1)))));
+}
+
+inline float cg_half_to_float( ushort h )
+{
+	uint sign=uint(h&0x8000)<<16, e=(h>>10)&0x1f, m=h&0x3ff, x;
+	if(e==0){ float f=m/16777216.0f; return sign?-f:f; }		// subnormal or zero
+	else if(e==31) x = sign|0x7f800000|(m<<13);				// inf or nan
+	else x = sign|((e+112)<<23)|(m<<13);
+	float f; memcpy( &f, &x, sizeof(f) ); return f;
+}
+
+inline vec2 cg_oct_encode( vec3 n )
+{
+	float l1 = fabs(n.x)+fabs(n.y)+fabs(n.z); if(l1==0) return vec2(0,0);
+	vec2 p = vec2(n.x,n.y)/l1; if(n.z>=0) return p;
+	return vec2( (1.0f-fabs(p.y))*(p.x>=0?1.0f:-1.0f), (1.0f-fabs(p.x))*(p.y>=0?1.0f:-1.0f) );
+}
+
+inline vec3 cg_oct_decode( vec2 e )
+{
+	vec3 n = vec3( e.x, e.y, 1.0f-fabs(e.x)-fabs(e.y) );
+	if(n.z<0){ float x=n.x; n.x=(1.0f-fabs(n.y))*(x>=0?1.0f:-1.0f); n.y=(1.0f-fabs(x))*(n.y>=0?1.0f:-1.0f); }
+	return n.normalize();
+}
+
+// pack vertices, and return the dequantization parameters of positions
+inline vertex_quant cg_pack_vertices( const vertex* vertices, size_t vertex_count, std::vector<packed_vertex>& out )
+{
+	vertex_quant q; out.resize( vertex_count ); if(!vertex_count) return q;
+	vec3 lo=vertices[0].pos, hi=lo;
+	for( size_t k=1; k < vertex_count; k++ ) for( int d=0; d < 3; d++ ){ lo[d]=std::min(lo[d],vertices[k].pos[d]); hi[d]=std::max(hi[d],vertices[k].pos[d]); }
+	q.offset = lo; for( int d=0; d < 3; d++ ) q.scale[d] = hi[d]>lo[d]?hi[d]-lo[d]:1.0f;
+
+	auto unorm16 = []( float f ){ return ushort(std::min(std::max(f,0.0f),1.0f)*65535.0f+0.5f); };
+	auto snorm16 = []( float f ){ return short(lroundf(std::min(std::max(f,-1.0f),1.0f)*32767.0f)); };
+	for( size_t k=0; k < vertex_count; k++ )
+	{
+		const vertex& v = vertices[k]; packed_vertex& p = out[k];
+		for( int d=0; d < 3; d++ ) p.pos[d] = unorm16( (v.pos[d]-q.offset[d])/q.scale[d] );
+		vec2 e = cg_oct_encode( v.norm );
+		p.pos[3] = 0; p.norm[0] = snorm16(e.x); p.norm[1] = snorm16(e.y);
+		p.tex[0] = cg_float_to_half(v.tex.x); p.tex[1] = cg_float_to_half(v.tex.y);
+	}
+	return q;
+}
+
+// CPU mirror of the shader-side dequantization
+inline vertex cg_unpack_vertex( const packed_vertex& p, const vertex_quant& q )
+{
+	vertex v;
+	for( int d=0; d < 3; d++ ) v.pos[d] = q.offset[d]+q.scale[d]*(p.pos[d]/65535.0f);
+	v.norm = cg_oct_decode( vec2( std::max(p.norm[0]/32767.0f,-1.0f), std::max(p.norm[1]/32767.0f,-1.0f) ) );
+	v.tex = vec2( cg_half_to_float(p.tex[0]), cg_half_to_float(p.tex[1]) );
+	return v;
+}
+
+//*************************************
+// post-transform vertex cache optimization
+// statistics of a FIFO post-transform cache simulated on CPU
+struct vcache_stats_t
+{
+	float	acmr = 0;	// average cache miss ratio: transformed vertices per triangle (0.5 at best, 3 at worst)
+	float	atvr = 0;	// average transform to vertex ratio: transformed vertices per referenced vertex (1 at best)
+};
+
+inline vcache_stats_t cg_vcache_stats( const uint* indices, size_t index_count, size_t vertex_count, uint cache_size=16 )
+{
+	vcache_stats_t s; if(index_count<3) return s;
+	std::vector<uint> t(vertex_count,0); // time stamps of entering the cache; 0 for never
+	size_t misses=0, referenced=0; uint now=cache_size+1;
+	for( size_t k=0; k < index_count; k++ )
+	{
+		uint v=indices[k]; if(v>=vertex_count) continue;
+		if(t[v]==0) referenced++;
+		if(t[v]==0||now-t[v]>cache_size){ t[v]=now++; misses++; } // FIFO: hits do not refresh the stamp
+	}
+	s.acmr = float(misses)/float(index_count/3);
+	s.atvr = referenced ? float(misses)/float(referenced) : 0;
+	return s;
+}
+
+// triangle reordering for the post-transform cache (Tipsify; Sander et al. 2007)
+inline void cg_optimize_vertex_cache( uint* indices, size_t index_count, size_t vertex_count, uint cache_size=16 )
+{
+	size_t tri_count = index_count/3; if(tri_count==0||vertex_count==0) return;
+
+	// vertex-triangle adjacency
+	std::vector<uint> offset(vertex_count+1,0), live(vertex_count,0), adj(tri_count*3);
+	for( size_t k=0; k < tri_count*3; k++ ) if(indices[k]<vertex_count) live[indices[k]]++;
+	for( size_t v=0; v < vertex_count; v++ ) offset[v+1] = offset[v]+live[v];
+	std::vector<uint> fill(offset.begin(),offset.end()-1);
+	for( size_t k=0; k < tri_count*3; k++ ) if(indices[k]<vertex_count) adj[fill[indices[k]]++] = uint(k/3);
+
+	std::vector<uint> stamp(vertex_count,0), dead_end, candidates, out; out.reserve(tri_count*3);
+	std::vector<bool> emitted(tri_count,false);
+	uint now=cache_size+1; size_t cursor=0;
+
+	auto skip_dead_end = [&]() -> int64_t
+	{
+		while(!dead_end.empty()){ uint d=dead_end.back(); dead_end.pop_back(); if(live[d]>0) return d; }
+		for( ; cursor < vertex_count; cursor++ ) if(live[cursor]>0) return int64_t(cursor);
+		return -1;
+	};
+
+	for( int64_t f=skip_dead_end(); f>=0; )
+	{
+		// emit all the remaining triangles of the fanning vertex
+		candidates.clear();
+		for( uint a=offset[f]; a < offset[f+1]; a++ )
+		{
+			uint t=adj[a]; if(emitted[t]) continue;
+			for( int j=0; j < 3; j++ )
+			{
+				uint v=indices[t*3+j]; out.push_back(v); if(v>=vertex_count) continue;
+				dead_end.push_back(v); candidates.push_back(v); live[v]--;
+				if(now-stamp[v]>cache_size) stamp[v]=now++;
+			}
+			emitted[t]=true;
+		}
+
+		// next fanning vertex: the oldest candidate which still stays in the cache after its remaining triangles
+		int64_t n=-1; int m=-1;
+		for( uint v : candidates ) if(live[v]>0)
+		{
+			int p=0; if(now-stamp[v]+2*live[v]<=cache_size) p=int(now-stamp[v]);
+			if(p>m){ m=p; n=v; }
+		}
+		f = n>=0 ? n : skip_dead_end();
+	}
+
+	// degenerated triangles referring to out-of-range vertices are kept at the end
+	for( size_t t=0; t < tri_count; t++ ) if(!emitted[t]) for( int j=0; j < 3; j++ ) out.push_back(indices[t*3+j]);
+	memcpy( indices, out.data(), sizeof(uint)*tri_count*3 );
+}
+
+// vertex reordering in the first-use order of indices for the pre-transform (fetch) locality;
+// unreferenced vertices are dropped, and the new vertex count is returned
+template <class V> inline size_t cg_optimize_vertex_fetch( V* vertices, size_t vertex_count, uint* indices, size_t index_count )
+{
+	std::vector<uint> remap(vertex_count,~0u); std::vector<V> v; v.reserve(vertex_count);
+	for( size_t k=0; k < index_count; k++ )
+	{
+		uint& i=indices[k]; if(i>=vertex_count) continue;
+		if(remap[i]==~0u){ remap[i]=uint(v.size()); v.push_back(vertices[i]); }
+		i = remap[i];
+	}
+	std::copy( v.begin(), v.end(), vertices );
+	return v.size();
+}
+
+// both optimizations for host-side lists; returns the statistics before/after the optimization
+inline std::pair<vcache_stats_t,vcache_stats_t> cg_optimize_mesh( std::vector<vertex>& vertex_list, std::vector<uint>& index_list, uint cache_size=16 )
+{
+	vcache_stats_t s0 = cg_vcache_stats( index_list.data(), index_list.size(), vertex_list.size(), cache_size );
+	cg_optimize_vertex_cache( index_list.data(), index_list.size(), vertex_list.size(), cache_size );
+	vertex_list.resize( cg_optimize_vertex_fetch( vertex_list.data(), vertex_list.size(), index_list.data(), index_list.size() ) );
+	return { s0, cg_vcache_stats( index_list.data(), index_list.size(), vertex_list.size(), cache_size ) };
+}
+
 struct image
 {
 	unsigned char*	ptr = nullptr; // image content
@@ -223,14 +499,41 @@ struct image
 	GLint format(){ return channels==1?GL_RED:channels==2?GL_RG:channels==3?GL_RGB:GL_RGBA; }
 };
 
+// bounding volumes of a mesh in object space for culling
+struct mesh_bounds
+{
+	vec3	box_min = vec3(0,0,0), box_max = vec3(0,0,0);	// AABB
+	vec4	sphere = vec4(0,0,0,0);							// (center, radius) around the center of AABB
+
+	void update( const vertex* v, size_t n )
+	{
+		if(!n) return;
+		box_min = box_max = v[0].pos;
+		for( size_t k=1; k < n; k++ ) for( int d=0; d < 3; d++ ){ box_min[d] = std::min(box_min[d],v[k].pos[d]); box_max[d] = std::max(box_max[d],v[k].pos[d]); }
+		vec3 c = (box_min+box_max)*0.5f; float r2=0;
+		for( size_t k=0; k < n; k++ ){ vec3 d=v[k].pos-c; r2 = std::max(r2,d.x*d.x+d.y*d.y+d.z*d.z); }
+		sphere = vec4( c.x, c.y, c.z, sqrtf(r2) );
+	}
+	void set_box( const vec3& bmin, const vec3& bmax ) // without vertices: the sphere circumscribes the box
+	{
+		box_min = bmin; box_max = bmax; vec3 c = (bmin+bmax)*0.5f, e = (bmax-bmin)*0.5f;
+		sphere = vec4( c.x, c.y, c.z, sqrtf(e.x*e.x+e.y*e.y+e.z*e.z) );
+	}
+};
+
 struct mesh
 {
-	std::vector<vertex>	vertex_list;
-	std::vector<uint>	index_list;
+	std::vector<vertex>	vertex_list;	// host copy: empty when uploaded from mapped files
+	std::vector<uint>	index_list;		// host copy: empty when uploaded from mapped files
+	uint	vertex_count = 0;
+	uint	index_count = 0;
 	GLuint	vertex_buffer = 0;
 	GLuint	index_buffer = 0;
 	GLuint	vertex_array = 0;
 	GLuint	texture = 0;
+	bool			b_packed = false;	// vertex_buffer holds packed_vertex
+	vertex_quant	quant;				// position dequantization for packed vertices
+	mesh_bounds		bounds;				// AABB and bounding sphere
 
 	~mesh()
 	{
@@ -529,6 +832,39 @@ inline GLuint cg_create_program( const char* vert_path, const char* frag_path )
 	return program;
 }
 
+//*************************************
+// program wrapper: active uniforms are introspected once after linking,
+// so that per-frame code uses cached locations without string lookups
+struct cg_program
+{
+	GLuint	id = 0;
+	std::unordered_map<std::string,GLint> uniform_map; // active uniform name -> location
+
+	cg_program() = default;
+	cg_program( GLuint program ){ reflect(program); }
+	operator GLuint() const { return id; }
+
+	// location of an active uniform (-1 if inactive); query once and keep the handle
+	GLint uniform( const char* name ) const { auto it=uniform_map.find(name); return it==uniform_map.end()?-1:it->second; }
+
+	inline void reflect( GLuint program )
+	{
+		id = program; uniform_map.clear(); if(!id) return;
+		GLint count=0, max_length=0;
+		glGetProgramiv( id, GL_ACTIVE_UNIFORMS, &count );
+		glGetProgramiv( id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length );
+		std::vector<char> name(size_t(max_length)+1,0);
+		for( GLint k=0; k<count; k++ )
+		{
+			GLint size=0; GLenum type=0; GLsizei length=0;
+			glGetActiveUniform( id, GLuint(k), GLsizei(name.size()), &length, &size, &type, name.data() );
+			GLint loc = glGetUniformLocation( id, name.data() ); if(loc<0) continue; // members of uniform blocks
+			std::string s(name.data(),size_t(length)); uniform_map[s] = loc;
+			if(s.size()>3&&s.compare(s.size()-3,3,"[0]")==0) uniform_map[s.substr(0,s.size()-3)] = loc; // arrays also by their base names
+		}
+	}
+};
+
 inline uint cg_create_vertex_array( uint vertex_buffer, uint index_buffer=0 )
 {
 	if(!vertex_buffer){ printf("%s(): vertex_buffer == 0\n", __func__ ); return 0; }
@@ -557,57 +893,268 @@ inline uint cg_create_vertex_array( uint vertex_buffer, uint index_buffer=0 )
 	return vao;
 }
 
+// the same as above, but for the given vertex layout: e.g., cg_create_vertex_array<packed_vertex>(vb,ib)
+template <class V> inline uint cg_create_vertex_array( uint vertex_buffer, uint index_buffer=0 );
+template <> inline uint cg_create_vertex_array<vertex>( uint vertex_buffer, uint index_buffer ){ return cg_create_vertex_array( vertex_buffer, index_buffer ); }
+template <> inline uint cg_create_vertex_array<packed_vertex>( uint vertex_buffer, uint index_buffer )
+{
+	if(!vertex_buffer){ printf("%s(): vertex_buffer == 0\n", __func__ ); return 0; }
+
+	// create and bind a vertex array object
+	GLuint vao = 0;
+	glGenVertexArrays( 1, &vao );
+	glBindVertexArray( vao );
+
+	// bind vertex/index buffer
+	glBindBuffer( GL_ARRAY_BUFFER, vertex_buffer );
+	if(index_buffer) glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer );
+
+	// the same locations as struct vertex; normalized integers arrive in shaders as floats in [0,1] or [-1,1]
+	glEnableVertexAttribArray( 0 ); glVertexAttribPointer( 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(packed_vertex), (GLvoid*) offsetof(packed_vertex,pos) );
+	glEnableVertexAttribArray( 1 ); glVertexAttribPointer( 1, 2, GL_SHORT, GL_TRUE, sizeof(packed_vertex), (GLvoid*) offsetof(packed_vertex,norm) );
+	glEnableVertexAttribArray( 2 ); glVertexAttribPointer( 2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(packed_vertex), (GLvoid*) offsetof(packed_vertex,tex) );
+
+	// unbind vao and return
+	glBindVertexArray( 0 );
+	return vao;
+}
+
+//*************************************
+// streaming ring buffer for per-frame dynamic data (e.g., instance attributes)
+// with GL 4.4 (glBufferStorage), the buffer is mapped once persistently and split into frame regions;
+// each frame writes into its own region, and a fence of the region is waited only when the ring wraps around.
+// otherwise (or GLES), each frame orphans the buffer by glBufferData(NULL) and uploads by glBufferSubData().
+// usage: reserve(size); begin_frame(); p=map(size,offset); write p; unmap(); bind at offset and draw; end_frame()
+// offsets of a frame stay valid until end_frame(), so map() fails instead of growing; reserve() grows the regions between frames.
+struct cg_stream_buffer
+{
+	GLuint				id = 0;
+	GLenum				target = GL_ARRAY_BUFFER;
+	size_t				region_size = 0;	// bytes per frame
+	uint				frames = 3;			// regions in flight
+	uint				frame = 0;			// current region
+	size_t				offset = 0;			// bytes used in the current region
+	size_t				stalls = 0;			// waits on fences not signaled yet; non-zero when the GPU lags by more than frames
+	char*				ptr = nullptr;		// persistent mapping, or nullptr for orphaning
+	std::vector<char>	staging;			// host memory of map() for orphaning
+	size_t				map_offset = 0, map_size = 0;
+#ifndef GL_ES_VERSION_2_0
+	std::vector<GLsync>	fences;
+#endif
+
+	bool	persistent() const { return ptr!=nullptr; }
+	bool	create( GLenum target, size_t region_size, uint frames=3, bool b_persistent=true );
+	void	release();	// call while the context is alive
+	bool	reserve( size_t region_size );	// recreates the buffer with larger regions if needed; call outside of begin_frame() and end_frame()
+	void	begin_frame();
+	void*	map( size_t size, size_t& out_offset, size_t alignment=256 ); // returns nullptr on failure, e.g., beyond the region
+	void	unmap();
+	void	end_frame();
+};
+
+inline bool cg_stream_buffer::create( GLenum _target, size_t _region_size, uint _frames, bool b_persistent )
+{
+	release();
+	target = _target; region_size = (_region_size+255)&~size_t(255); frames = std::max(1u,_frames); frame = 0; offset = 0;
+	glGenBuffers( 1, &id ); if(!id){ printf( "%s(): failed to create a buffer\n", __func__ ); return false; }
+	glBindBuffer( target, id );
+#ifndef GL_ES_VERSION_2_0
+	if(b_persistent&&gl_version_t::instance().gl()>=44&&glBufferStorage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT|GL_MAP_PERSISTENT_BIT|GL_MAP_COHERENT_BIT;
+		glBufferStorage( target, GLsizeiptr(region_size*frames), nullptr, flags );
+		ptr = (char*) glMapBufferRange( target, 0, GLsizeiptr(region_size*frames), flags );
+		if(!ptr){ printf( "%s(): failed to map a persistent buffer; fall back to orphaning\n", __func__ ); glDeleteBuffers( 1, &id ); glGenBuffers( 1, &id ); glBindBuffer( target, id ); }
+		else fences.assign( frames, nullptr );
+	}
+#endif
+	if(!ptr){ glBufferData( target, GLsizeiptr(region_size), nullptr, GL_STREAM_DRAW ); staging.resize( region_size ); }
+	glBindBuffer( target, 0 );
+	return true;
+}
+
+inline void cg_stream_buffer::release()
+{
+	if(!id) return;
+#ifndef GL_ES_VERSION_2_0
+	for( auto& f : fences ) if(f){ glDeleteSync(f); f = nullptr; }
+	if(ptr){ glBindBuffer( target, id ); glUnmapBuffer( target ); glBindBuffer( target, 0 ); ptr = nullptr; }
+#endif
+	glDeleteBuffers( 1, &id ); id = 0; staging.clear();
+}
+
+inline bool cg_stream_buffer::reserve( size_t size )
+{
+	if(id&&size<=region_size) return true;
+
+	// grow to a power of two; the only reallocations, which happen while the data size increases
+	size_t r=std::max(region_size,size_t(256)); while(r<size) r*=2;
+	if(!create( target, r, frames, persistent()||!id )) return false;
+	printf( "> %s stream buffer of %u x %zu KB\n", persistent()?"persistent-mapped":"orphaned", persistent()?frames:1, r/1024 );
+	return true;
+}
+
+inline void cg_stream_buffer::begin_frame()
+{
+	offset = 0;
+	if(!id) return;
+#ifndef GL_ES_VERSION_2_0
+	if(ptr)
+	{
+		frame = (frame+1)%frames;
+		GLsync& f = fences[frame]; if(!f) return;
+		if(glClientWaitSync( f, 0, 0 )==GL_TIMEOUT_EXPIRED)
+		{
+			stalls++;
+			while(glClientWaitSync( f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 )==GL_TIMEOUT_EXPIRED){}
+		}
+		glDeleteSync( f ); f = nullptr;
+		return;
+	}
+#endif
+	// orphaning: the driver allocates new storage while the GPU still reads the previous one
+	glBindBuffer( target, id );
+	glBufferData( target, GLsizeiptr(region_size), nullptr, GL_STREAM_DRAW );
+	glBindBuffer( target, 0 );
+}
+
+inline void* cg_stream_buffer::map( size_t size, size_t& out_offset, size_t alignment )
+{
+	size_t o = (offset+alignment-1)/alignment*alignment;
+	if(!id||o+size>region_size){ printf( "%s(): %zu bytes at %zu exceed the region of %zu bytes; reserve() before begin_frame()\n", __func__, size, o, region_size ); return nullptr; }
+	offset = o+size; out_offset = map_offset = persistent() ? region_size*frame+o : o; map_size = size;
+	return persistent() ? ptr+map_offset : staging.data()+o;
+}
+
+inline void cg_stream_buffer::unmap()
+{
+	if(persistent()||!map_size) return; // coherent mapping needs no flush
+	glBindBuffer( target, id );
+	glBufferSubData( target, GLintptr(map_offset), GLsizeiptr(map_size), staging.data()+map_offset );
+	glBindBuffer( target, 0 );
+	map_size = 0;
+}
+
+inline void cg_stream_buffer::end_frame()
+{
+#ifndef GL_ES_VERSION_2_0
+	if(ptr) fences[frame] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+#endif
+}
+
+// map a binary file of T elements after validating its size and alignment
+template <class T> inline bool cg_map_elements( const char* binary_path, mapped_t& m, const char* caller )
+{
+	binary_path = absolute_path(binary_path);
+	if(access(binary_path,0)!=0){ printf( "%s(): %s not exists\n", caller, binary_path ); return false; }
+	if(!m.map(binary_path)){ printf( "%s(): failed to map %s\n", caller, binary_path ); return false; }
+	if(m.size%sizeof(T)||size_t(m.ptr)%alignof(T)){ printf( "%s(): %s is not a valid binary file of %zu-byte elements\n", caller, binary_path, sizeof(T) ); m.unmap(); return false; }
+	return true;
+}
+
 inline bool cg_load_vertices( const char* vert_binary_path, std::vector<vertex>* p_out_vertices )
 {
-	vert_binary_path = absolute_path(vert_binary_path);
-	if(access(vert_binary_path,0)!=0){ printf( "%s(): %s not exists\n", __func__, vert_binary_path ); return false; }
-	mem_t v = cg_read_binary(vert_binary_path); if(!v.ptr){ printf( "%s(): failed to read %s\n", __func__, vert_binary_path ); return false; }
-	if(v.size%sizeof(vertex)){ printf( "%s(): %s is not a valid vertex binary file\n", __func__, vert_binary_path ); return false; }
 	if(!p_out_vertices){ printf( "%s(): p_out_vertices == nullptr\n", __func__ ); return false; }
-	p_out_vertices->resize( v.size/sizeof(vertex) );
-	memcpy( (void*)p_out_vertices->data(), v.ptr, v.size );
-	free(v.ptr);
+	mapped_t v; if(!cg_map_elements<vertex>( vert_binary_path, v, __func__ )) return false;
+	p_out_vertices->assign( (const vertex*) v.ptr, (const vertex*)(v.ptr+v.size) ); // a single copy from the mapped pages
 	return true;
 }
 
 inline bool cg_load_indices( const char* index_binary_path, std::vector<uint>* p_out_indices )
 {
-	index_binary_path = absolute_path(index_binary_path);
-	if(access(index_binary_path,0)!=0){ printf( "%s(): %s not exists\n", __func__, index_binary_path ); return false; }
-	mem_t i = cg_read_binary(index_binary_path); if(!i.ptr){ printf( "%s(): failed to read %s\n", __func__, index_binary_path ); return false; }
-	if(i.size%sizeof(uint)){ printf( "%s(): %s is not a valid index binary file\n", __func__, index_binary_path ); return false; }
 	if(!p_out_indices){ printf( "%s(): p_out_indices == nullptr\n", __func__ ); return false; }
-	p_out_indices->resize( i.size/sizeof(uint) );
-	memcpy( p_out_indices->data(), i.ptr, i.size );
-	free(i.ptr);
+	mapped_t i; if(!cg_map_elements<uint>( index_binary_path, i, __func__ )) return false;
+	p_out_indices->assign( (const uint*) i.ptr, (const uint*)(i.ptr+i.size) ); // a single copy from the mapped pages
 	return true;
 }
 
-inline mesh* cg_load_mesh( const char* vert_binary_path, const char* index_binary_path )
+// create GPU buffers and a vertex array from vertex/index arrays in host memory; V is vertex or packed_vertex
+template <class V> inline mesh* cg_create_mesh( const V* vertices, size_t vertex_count, const uint* indices, size_t index_count )
 {
 	mesh* new_mesh = new mesh();
-
-	// load vertex/index buffers
-	if(!cg_load_vertices( vert_binary_path, &new_mesh->vertex_list )) return nullptr;
-	if(!cg_load_indices( index_binary_path, &new_mesh->index_list )) return nullptr;
+	new_mesh->vertex_count = uint(vertex_count);
+	new_mesh->index_count = uint(index_count);
 
 	// create a vertex buffer
 	glGenBuffers( 1, &new_mesh->vertex_buffer );
 	glBindBuffer( GL_ARRAY_BUFFER, new_mesh->vertex_buffer );
-	glBufferData( GL_ARRAY_BUFFER, sizeof(vertex)*new_mesh->vertex_list.size(), &new_mesh->vertex_list[0], GL_STATIC_DRAW );
+	glBufferData( GL_ARRAY_BUFFER, sizeof(V)*vertex_count, vertices, GL_STATIC_DRAW );
 
 	// create a index buffer
 	glGenBuffers( 1, &new_mesh->index_buffer );
 	glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, new_mesh->index_buffer );
-	glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(uint)*new_mesh->index_list.size(), &new_mesh->index_list[0], GL_STATIC_DRAW );
+	glBufferData( GL_ELEMENT_ARRAY_BUFFER, sizeof(uint)*index_count, indices, GL_STATIC_DRAW );
 
 	// generate vertex array object, which is mandatory for OpenGL 3.3 and higher
-	new_mesh->vertex_array = cg_create_vertex_array( new_mesh->vertex_buffer, new_mesh->index_buffer );
-	if(!new_mesh->vertex_array){ printf("%s(): failed to create vertex aray\n",__func__); return nullptr; }
+	new_mesh->b_packed = std::is_same<V,packed_vertex>::value;
+	new_mesh->vertex_array = cg_create_vertex_array<V>( new_mesh->vertex_buffer, new_mesh->index_buffer );
+	if(!new_mesh->vertex_array){ printf("%s(): failed to create vertex aray\n",__func__); delete new_mesh; return nullptr; }
+
+	return new_mesh;
+}
+
+// options of cg_load_mesh()
+enum mesh_flag : uint
+{
+	MESH_HOST_COPY	= 1,	// keep host copies in vertex_list/index_list
+	MESH_PACK		= 2,	// upload packed_vertex at half the size, which needs dequantization in shaders
+	MESH_OPTIMIZE	= 4,	// reorder triangles/vertices for vertex caches, and report ACMR/ATVR
+};
+
+// CPU-side staging of a mesh: no GL calls, and thus safe in worker threads
+struct mesh_staging
+{
+	uint						flags = 0;
+	mapped_t					v, i;		// mapped binaries
+	std::vector<vertex>			vertices;	// copies only when modified or kept in host
+	std::vector<uint>			indices;
+	std::vector<packed_vertex>	packed;
+	vertex_quant				quant;
+	const vertex*	vp=nullptr;	size_t vn=0;	// vertices to upload
+	const uint*		ip=nullptr;	size_t in=0;	// indices to upload
+};
 
+inline bool cg_stage_mesh( const char* vert_binary_path, const char* index_binary_path, uint flags, mesh_staging& s )
+{
+	s.flags = flags;
+	if(!cg_map_elements<vertex>( vert_binary_path, s.v, "cg_load_mesh" )) return false;
+	if(!cg_map_elements<uint>( index_binary_path, s.i, "cg_load_mesh" )) return false;
+	s.vp=(const vertex*) s.v.ptr; s.vn=s.v.size/sizeof(vertex);
+	s.ip=(const uint*) s.i.ptr; s.in=s.i.size/sizeof(uint);
+
+	// mapped pages are read-only; copy only when reordering or keeping the host lists
+	if(flags&(MESH_OPTIMIZE|MESH_HOST_COPY))
+	{
+		s.vertices.assign( s.vp, s.vp+s.vn ); s.indices.assign( s.ip, s.ip+s.in ); s.v.unmap(); s.i.unmap();
+		if(flags&MESH_OPTIMIZE)
+		{
+			auto r = cg_optimize_mesh( s.vertices, s.indices );
+			printf( "> %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", vert_binary_path, r.first.acmr, r.second.acmr, r.first.atvr, r.second.atvr );
+		}
+		s.vp=s.vertices.data(); s.vn=s.vertices.size(); s.ip=s.indices.data(); s.in=s.indices.size();
+	}
+	if(flags&MESH_PACK) s.quant = cg_pack_vertices( s.vp, s.vn, s.packed );
+	return true;
+}
+
+inline mesh* cg_upload_mesh( mesh_staging& s )
+{
+	mesh* new_mesh = (s.flags&MESH_PACK) ? cg_create_mesh( s.packed.data(), s.packed.size(), s.ip, s.in ) : cg_create_mesh( s.vp, s.vn, s.ip, s.in );
+	if(!new_mesh) return nullptr;
+	new_mesh->quant = s.quant;
+	new_mesh->bounds.update( s.vp, s.vn );
+	if(s.flags&MESH_HOST_COPY){ new_mesh->vertex_list.swap( s.vertices ); new_mesh->index_list.swap( s.indices ); }
 	return new_mesh;
 }
 
+// vertex/index binaries are mapped and uploaded to GPU without intermediate copies
+// unless the flags need modified or host-side copies
+inline mesh* cg_load_mesh( const char* vert_binary_path, const char* index_binary_path, uint flags=0 )
+{
+	mesh_staging s;
+	return cg_stage_mesh( vert_binary_path, index_binary_path, flags, s ) ? cg_upload_mesh( s ) : nullptr;
+}
+
 #if defined(STBI_INCLUDE_STB_IMAGE_H)||defined(STBI_VERSION)
 // assume stb_image.h included somewhere with STB_IMAGE_IMPLEMENTATION
 extern "C" unsigned char* stbi_load(const char*,int*,int*,int*,int);
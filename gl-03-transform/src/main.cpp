@@ -1,5 +1,6 @@
 #include "cgmath.h"		// slee's simple math library
 #include "cgut.h"		// slee's OpenGL utility
+#include "cgasync.h"	// background asset loader
 
 //*************************************
 // global constants
@@ -8,8 +9,9 @@ static const char*	vert_shader_path = "shaders/transform.vert";
 static const char*	frag_shader_path = "shaders/transform.frag";
 static const char*	mesh_vertex_path = "mesh/dragon.vertex.bin";
 static const char*	mesh_index_path	= "mesh/dragon.index.bin";
+static const char*	mesh_pack_path	= "mesh/dragon.pack.bin";	// built by tools/meshpack
 static const uint	MIN_INSTANCE = 1;	// minimum instances
-static const uint	MAX_INSTANCE = 3;	// maximum instances
+static const uint	MAX_INSTANCE = 4096;	// maximum instances
 uint				NUM_INSTANCE = 1;	// initial instances
 
 //*************************************
@@ -35,28 +37,91 @@ ivec2		window_size = cg_default_window_size(); // initial window size
 
 //*************************************
 // OpenGL objects
-GLuint	program	= 0;	// ID holder for GPU program
+cg_program	program;	// GPU program with cached uniform locations
+cg_stream_buffer	instance_stream;	// ring buffer of per-instance model matrices
 
 //*************************************
 // global variables
 int		frame = 0;		// index of rendering frames
+bool	b_packed = false;	// render with packed vertices; toggled by 'p'
+bool	b_instanced = true;	// one instanced draw call instead of a draw call per instance; toggled by 'i'
+bool	b_culling = true;	// frustum culling of instances by bounding spheres; toggled by 'c'
+struct { size_t visible=0, culled=0; } cull_stats;	// instances of the last frame
+
+// CPU time of render() and GPU time of the draw calls, averaged over frames
+struct { GLuint query=0; bool b_pending=false; double cpu_msec=0, gpu_msec=0; } frame_timer;
 
 //*************************************
 // scene objects
-mesh*	p_mesh = nullptr;
-camera	cam;
+mesh*				p_mesh = nullptr;
+mesh*				p_packed = nullptr;	// the same mesh with packed_vertex
+cg_handle<mesh*>	mesh_handle;		// p_mesh is taken when the background loading is done
+cg_handle<mesh*>	packed_handle;		// p_packed is taken when the background loading is done
+camera				cam;
+std::vector<mat4>	instance_models;	// model matrices of the last batched pass
+std::vector<vec4>	instance_spheres;	// bounding spheres of the instances in world space
+std::vector<uchar>	instance_visible;	// results of frustum culling
+
+// uniform locations cached in user_init()
+struct { GLint view_matrix=-1, projection_matrix=-1, model_matrix=-1, b_packed=-1, pos_offset=-1, pos_scale=-1, b_instanced=-1; } uloc;
+
+//*************************************
+// model matrix of k-th instance at time t: rotation about cam.at followed by the move, as a dual quaternion
+inline mat4 instance_matrix( int k, float t )
+{
+	float theta	= t*((k%2)-0.5f)*float(k+1)*0.5f;
+	float move	= ((k%2)-0.5f)*300.0f*float((k+1)/2);
+	quat rotation = quat::rotate( vec3(0,0,1), theta );
+	return dquat( rotation, vec3(move,abs(move),0.0f)+cam.at-rotation*cam.at ).to_mat4();
+}
+
+// batched pass of all the instances: model matrices and bounding spheres, and then frustum culling
+// the model matrices are rigid, so the radius of the mesh's bounding sphere is kept
+inline void update_instances( int n, float t, const mesh* m )
+{
+	instance_models.resize(n); instance_spheres.resize(n); instance_visible.assign(n,1);
+	vec4 s = m->bounds.sphere;
+	for( int k=0; k < n; k++ )
+	{
+		instance_models[k] = instance_matrix( k, t );
+		vec4 c = instance_models[k]*vec4(s.x,s.y,s.z,1.0f);
+		instance_spheres[k] = vec4( c.x, c.y, c.z, s.w );
+	}
+	cull_stats.visible = b_culling ? cull_spheres( frustum(cam.projection_matrix*cam.view_matrix), instance_spheres.data(), n, instance_visible.data() ) : size_t(n);
+	cull_stats.culled = n-cull_stats.visible;
+}
+
+// per-instance model matrix at location 3-6 of a mesh's vertex array, advanced once per instance
+// pointers are moved to the region of each frame in render()
+void add_instance_attributes( mesh* m )
+{
+	if(!m||!m->vertex_array) return;
+	glBindVertexArray( m->vertex_array );
+	glBindBuffer( GL_ARRAY_BUFFER, instance_stream.id );
+	for( GLuint k=0; k < 4; k++ )
+	{
+		glEnableVertexAttribArray( 3+k );
+		glVertexAttribPointer( 3+k, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (GLvoid*)(sizeof(vec4)*k) );
+		glVertexAttribDivisor( 3+k, 1 );
+	}
+	glBindVertexArray( 0 );
+}
 
 //*************************************
 void update()
 {
+	// take the mesh streamed in by the background loader
+	if(!p_mesh&&mesh_handle.ready()){ p_mesh = mesh_handle.get(); add_instance_attributes( p_mesh ); printf( "> mesh loaded at frame %d\n", frame ); }
+	else if(mesh_handle.failed()){ printf( "Unable to load mesh\n" ); glfwSetWindowShouldClose( window, GL_TRUE ); }
+	if(!p_packed&&packed_handle.ready()){ p_packed = packed_handle.get(); add_instance_attributes( p_packed ); }
+
 	// update projection matrix
 	cam.aspect = window_size.x/float(window_size.y);
 	cam.projection_matrix = mat4::perspective( cam.fovy, cam.aspect, cam.dnear, cam.dfar );
 
 	// update uniform variables in vertex/fragment shaders
-	GLint uloc;
-	uloc = glGetUniformLocation( program, "view_matrix" );			if(uloc>-1) glUniformMatrix4fv( uloc, 1, GL_TRUE, cam.view_matrix );		// update the view matrix (covered later in viewing lecture)
-	uloc = glGetUniformLocation( program, "projection_matrix" );	if(uloc>-1) glUniformMatrix4fv( uloc, 1, GL_TRUE, cam.projection_matrix );	// update the projection matrix (covered later in viewing lecture)
+	if(uloc.view_matrix>-1)			glUniformMatrix4fv( uloc.view_matrix, 1, GL_TRUE, cam.view_matrix );				// update the view matrix (covered later in viewing lecture)
+	if(uloc.projection_matrix>-1)	glUniformMatrix4fv( uloc.projection_matrix, 1, GL_TRUE, cam.projection_matrix );	// update the projection matrix (covered later in viewing lecture)
 }
 
 void render()
@@ -68,27 +133,59 @@ void render()
 	glUseProgram( program );
 	
 	// bind vertex array object
-	if(p_mesh&&p_mesh->vertex_array) glBindVertexArray( p_mesh->vertex_array );
+	mesh* m = b_packed&&p_packed ? p_packed : p_mesh;
+	if(m&&m->vertex_array) glBindVertexArray( m->vertex_array );
+	else{ glfwSwapBuffers( window ); return; } // nothing to draw until the mesh is loaded
 
-	// render vertices: trigger shader programs to process vertex data
-	for( int k=0, kn=int(NUM_INSTANCE); k<kn; k++ )
-	{
-		// configure transformation parameters
-		double t = glfwGetTime();
-		float theta	= float(t)*((k%2)-0.5f)*float(k+1)*0.5f;
-		float move	= ((k%2)-0.5f)*300.0f*float((k+1)/2);
+	// dequantization parameters of packed vertices
+	if(uloc.b_packed>-1)	glUniform1i( uloc.b_packed, m->b_packed );
+	if(uloc.pos_offset>-1)	glUniform3fv( uloc.pos_offset, 1, m->quant.offset );
+	if(uloc.pos_scale>-1)	glUniform3fv( uloc.pos_scale, 1, m->quant.scale );
 
-		// build the model matrix
-		mat4 model_matrix = mat4::translate( move, abs(move), 0.0f ) *
-							mat4::translate( cam.at ) *
-							mat4::rotate( vec3(0,0,1), theta ) *
-							mat4::translate( -cam.at );
+	// collect the GPU time of a previous frame without waiting for it
+	double t0 = glfwGetTime();
+	bool b_timed = false;
+#ifndef GL_ES_VERSION_2_0
+	if(frame_timer.b_pending)
+	{
+		GLint available=0; glGetQueryObjectiv( frame_timer.query, GL_QUERY_RESULT_AVAILABLE, &available );
+		if(available){ GLuint64 ns=0; glGetQueryObjectui64v( frame_timer.query, GL_QUERY_RESULT, &ns ); frame_timer.gpu_msec = frame_timer.gpu_msec>0 ? frame_timer.gpu_msec*0.9+ns*1e-7 : ns*1e-6; frame_timer.b_pending = false; }
+	}
+	if(!frame_timer.b_pending){ glBeginQuery( GL_TIME_ELAPSED, frame_timer.query ); b_timed = true; }
+#endif
 
+	// render vertices: trigger shader programs to process vertex data
+	update_instances( int(NUM_INSTANCE), float(glfwGetTime()), m );
+	if(uloc.b_instanced>-1) glUniform1i( uloc.b_instanced, b_instanced );
+	if(b_instanced&&cull_stats.visible)
+	{
+		// the visible model matrices into this frame's region of the ring, and then a single draw call
+		// GLSL matrix attributes are column-major
+		// the ring is sized for MAX_INSTANCE, and waits only if the GPU still reads the region of three frames ago
+		size_t offset=0;
+		instance_stream.begin_frame();
+		mat4* matrices = (mat4*) instance_stream.map( sizeof(mat4)*cull_stats.visible, offset );
+		for( size_t k=0, j=0; matrices && k < NUM_INSTANCE; k++ ) if(instance_visible[k]) matrices[j++] = instance_models[k].transpose();
+		instance_stream.unmap();
+		glBindBuffer( GL_ARRAY_BUFFER, instance_stream.id );
+		for( GLuint k=0; k < 4; k++ ) glVertexAttribPointer( 3+k, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (GLvoid*)(offset+sizeof(vec4)*k) );
+		if(matrices) glDrawElementsInstanced( GL_TRIANGLES, GLsizei(m->index_count), GL_UNSIGNED_INT, nullptr, GLsizei(cull_stats.visible) );
+		instance_stream.end_frame();
+	}
+	else if(!b_instanced) for( int k=0, kn=int(NUM_INSTANCE); k<kn; k++ )
+	{
 		// update the uniform model matrix and render
-		glUniformMatrix4fv( glGetUniformLocation( program, "model_matrix" ), 1, GL_TRUE, model_matrix );
-		glDrawElements( GL_TRIANGLES, GLsizei(p_mesh->index_list.size()), GL_UNSIGNED_INT, nullptr );
+		if(!instance_visible[k]) continue;
+		glUniformMatrix4fv( uloc.model_matrix, 1, GL_TRUE, instance_models[k] );
+		glDrawElements( GL_TRIANGLES, GLsizei(m->index_count), GL_UNSIGNED_INT, nullptr );
 	}
 
+#ifndef GL_ES_VERSION_2_0
+	if(b_timed){ glEndQuery( GL_TIME_ELAPSED ); frame_timer.b_pending = true; }
+#endif
+	double cpu_msec = (glfwGetTime()-t0)*1000.0;
+	frame_timer.cpu_msec = frame_timer.cpu_msec>0 ? frame_timer.cpu_msec*0.9+cpu_msec*0.1 : cpu_msec;
+
 	// swap front and back buffers, and display to screen
 	glfwSwapBuffers( window );
 }
@@ -107,9 +204,34 @@ void print_help()
 	printf( "- press ESC or 'q' to terminate the program\n" );
 	printf( "- press F1 or 'h' to see help\n" );
 	printf( "- press '+/-' to increase/decrease the number of instances (min=%d, max=%d)\n", MIN_INSTANCE, MAX_INSTANCE );
+	printf( "- press 'p' to toggle packed vertices\n" );
+	printf( "- press 'i' to toggle instanced drawing and compare frame times\n" );
+	printf( "- press 'c' to toggle frustum culling of instances\n" );
+	printf( "- press 'e' to report quantization errors of packed vertices\n" );
 	printf( "\n" );
 }
 
+// max errors of packed vertices against the original vertices of the mesh
+void print_pack_error()
+{
+	std::vector<vertex> v; if(!cg_load_vertices( mesh_vertex_path, &v )) return;
+	std::vector<packed_vertex> p; vertex_quant q = cg_pack_vertices( v.data(), v.size(), p );
+
+	float pos_err=0, norm_err=0, tex_err=0;
+	for( size_t k=0; k < v.size(); k++ )
+	{
+		vertex u = cg_unpack_vertex( p[k], q );
+		for( int d=0; d < 3; d++ ) pos_err = std::max( pos_err, fabs(u.pos[d]-v[k].pos[d]) );
+		float l = v[k].norm.length(); if(l>0) norm_err = std::max( norm_err, acosf(std::min(1.0f,u.norm.dot(v[k].norm/l))) );
+		for( int d=0; d < 2; d++ ) tex_err = std::max( tex_err, fabs(u.tex[d]-v[k].tex[d]) );
+	}
+
+	printf( "> packed vertices: %zu vertices, %zu -> %zu bytes\n", v.size(), v.size()*sizeof(vertex), p.size()*sizeof(packed_vertex) );
+	printf( "  max position error = %g (%g of AABB diagonal)\n", pos_err, pos_err/q.scale.length() );
+	printf( "  max normal error   = %g degrees\n", norm_err*180.0f/PI );
+	printf( "  max texcoord error = %g\n", tex_err );
+}
+
 void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 {
 	if(action==GLFW_PRESS)
@@ -119,12 +241,33 @@ void keyboard( GLFWwindow* window, int key, int scancode, int action, int mods )
 		else if(key==GLFW_KEY_KP_ADD||(key==GLFW_KEY_EQUAL&&(mods&GLFW_MOD_SHIFT))/* + */)
 		{
 			if(NUM_INSTANCE>=MAX_INSTANCE) return;
-			printf( "> NUM_INSTANCE = % -4d\r", ++NUM_INSTANCE );
+			NUM_INSTANCE = NUM_INSTANCE<4 ? NUM_INSTANCE+1 : std::min(NUM_INSTANCE*2,MAX_INSTANCE); // doubled beyond a few
+			printf( "> NUM_INSTANCE = % -4d\r", NUM_INSTANCE );
 		}
 		else if(key==GLFW_KEY_KP_SUBTRACT||key==GLFW_KEY_MINUS)
 		{
 			if(NUM_INSTANCE<=MIN_INSTANCE) return;
-			printf( "> NUM_INSTANCE = % -4d\r", --NUM_INSTANCE );
+			NUM_INSTANCE = NUM_INSTANCE<=4 ? NUM_INSTANCE-1 : NUM_INSTANCE/2;
+			printf( "> NUM_INSTANCE = % -4d\r", NUM_INSTANCE );
+		}
+		else if(key==GLFW_KEY_P)
+		{
+			b_packed = !b_packed;
+			mesh* m = b_packed&&p_packed ? p_packed : p_mesh;
+			if(m) printf( "> packed vertices: %s (%zu bytes/vertex, %zu KB)\n", b_packed?"on":"off", m->b_packed?sizeof(packed_vertex):sizeof(vertex), size_t(m->vertex_count)*(m->b_packed?sizeof(packed_vertex):sizeof(vertex))/1024 );
+		}
+		else if(key==GLFW_KEY_E)	print_pack_error();
+		else if(key==GLFW_KEY_C)
+		{
+			b_culling = !b_culling;
+			printf( "> frustum culling: %s (%zu visible, %zu culled of %u instances in the last frame)\n", b_culling?"on":"off", cull_stats.visible, cull_stats.culled, NUM_INSTANCE );
+		}
+		else if(key==GLFW_KEY_I)
+		{
+			// report the averages of the mode being left; the averages restart from the new mode
+			printf( "> %s: %u instances (%zu visible, %zu culled) in %.3f ms on CPU and %.3f ms on GPU\n", b_instanced?"instanced":"per-instance draw calls", NUM_INSTANCE, cull_stats.visible, cull_stats.culled, frame_timer.cpu_msec, frame_timer.gpu_msec );
+			b_instanced = !b_instanced; frame_timer.cpu_msec = frame_timer.gpu_msec = 0;
+			printf( "> using %s\n", b_instanced?"instanced drawing":"per-instance draw calls" );
 		}
 	}
 }
@@ -152,15 +295,36 @@ bool user_init()
 	glEnable( GL_CULL_FACE );								// turn on backface culling
 	glEnable( GL_DEPTH_TEST );								// turn on depth tests
 
-	// load the mesh
-	p_mesh = cg_load_mesh( mesh_vertex_path, mesh_index_path );
-	if(p_mesh==nullptr){ printf( "Unable to load mesh\n" ); return false; }
+	// cache uniform locations
+	uloc.view_matrix		= program.uniform( "view_matrix" );
+	uloc.projection_matrix	= program.uniform( "projection_matrix" );
+	uloc.model_matrix		= program.uniform( "model_matrix" );
+	uloc.b_packed			= program.uniform( "b_packed" );
+	uloc.pos_offset			= program.uniform( "pos_offset" );
+	uloc.pos_scale			= program.uniform( "pos_scale" );
+	uloc.b_instanced		= program.uniform( "b_instanced" );
+
+	// ring buffer of model matrices up to MAX_INSTANCE per frame, and the timer query
+	instance_stream.create( GL_ARRAY_BUFFER, sizeof(mat4)*MAX_INSTANCE, 3 );
+#ifndef GL_ES_VERSION_2_0
+	glGenQueries( 1, &frame_timer.query );
+#endif
+
+	// load the mesh in background; the window appears without waiting for it
+	mesh_handle = cg_async_loader::instance().load_mesh( mesh_vertex_path, mesh_index_path, MESH_OPTIMIZE );
+	if(access(absolute_path(mesh_pack_path),0)==0)	packed_handle = cg_async_loader::instance().load_mesh_pack( mesh_pack_path );
+	else											packed_handle = cg_async_loader::instance().load_mesh( mesh_vertex_path, mesh_index_path, MESH_OPTIMIZE|MESH_PACK );
 
 	return true;
 }
 
 void user_finalize()
 {
+	if(instance_stream.stalls) printf( "> %zu frames waited for the GPU to release the stream buffer\n", instance_stream.stalls );
+	instance_stream.release();
+#ifndef GL_ES_VERSION_2_0
+	glDeleteQueries( 1, &frame_timer.query );
+#endif
 }
 
 int main( int argc, char* argv[] )
@@ -183,6 +347,7 @@ int main( int argc, char* argv[] )
 	for( frame=0; !glfwWindowShouldClose(window); frame++ )
 	{
 		glfwPollEvents();	// polling and processing of events
+		cg_async_loader::instance().poll();	// GL uploads of assets loaded in background
 		update();			// per-frame update
 		render();			// per-frame render
 	}
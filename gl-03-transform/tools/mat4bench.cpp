@@ -0,0 +1,123 @@
+// mat4bench: throughput of mat4 products and batched transformations against the per-element implementations
+// usage: mat4bench [repeats]; build with -mavx or -DCGMATH_NO_SIMD to compare instruction sets (e.g., inverse() of SSE against scalar)
+#include "cgmath.h"		// slee's simple math library
+#include <chrono>
+#include <thread>
+
+// compile-time checks of constexpr evaluation in cgmath.h
+static_assert( vec3(1,2,3).dot(vec3(4,5,6))==32 && cross(vec3(1,0,0),vec3(0,1,0)).z==1 && (2.0f*vec4(1,2,3,4)-1.0f).w==7, "constexpr vectors" );
+static_assert( mat4::identity().transpose().a[0]==1 && mat4::translate(1,2,3).transpose().a[13]==2 && mat4::scale(2,3,4).a[10]==4, "constexpr matrices" );
+static_assert( mat3(1,2,3,4,5,6,7,8,10).det()==-3 && mat3(mat4::scale(2,3,4)).a[8]==4, "constexpr mat3" );
+static_assert( quat(0,0,1,0).to_mat4().a[0]==-1 && (quat(0,0,1,0)*vec3(1,0,0)).x==-1 && dquat::translate(1,2,3).translation().z==3, "constexpr quaternions" );
+#if defined(CGMATH_CONSTEXPR_SIMD)||!(defined(CGMATH_AVX)||defined(CGMATH_SSE)||defined(CGMATH_NEON))
+static_assert( (mat4::translate(1,2,3)*mat4::scale(2,2,2)*vec4(1,1,1,1)).z==5 && (mat4::scale(2,3,4)*vec3(1,1,1)).y==3, "constexpr mat4 products" );
+#endif
+
+// the previous implementation: a transposed copy and dot products of row vectors
+static vec4 ref_mul( const mat4& m, const vec4& v ){ return vec4(m.rvec4(0).dot(v), m.rvec4(1).dot(v), m.rvec4(2).dot(v), m.rvec4(3).dot(v)); }
+static mat4 ref_mul( const mat4& l, const mat4& m ){ mat4 t=m.transpose(), r; for(int k=0;k<4;k++) r.rvec4(k)=ref_mul(t,l.rvec4(k)); return r; }
+
+struct trs_t { vec3 move, at, axis; float theta; };
+
+// chained TRS composition as in render() of gl-03-transform
+template <class M> static mat4 compose( const trs_t& p, M mul )
+{
+	return mul( mul( mul( mat4::translate(p.move), mat4::translate(p.at) ), mat4::rotate(p.axis,p.theta) ), mat4::translate(-p.at) );
+}
+
+// minimal parallel_for for the parallel overloads of the batched transformations
+struct threads_t
+{
+	uint count = std::max(1u,std::thread::hardware_concurrency());
+	template <class F> void parallel_for( size_t n, size_t chunk, F f )
+	{
+		std::vector<std::thread> t; size_t chunks=(n+chunk-1)/chunk;
+		for( uint w=0; w < count; w++ ) t.emplace_back( [&,w](){ for( size_t c=chunks*w/count, e=chunks*(w+1)/count; c < e; c++ ) f( c*chunk, std::min(n,(c+1)*chunk) ); } );
+		for( auto& h : t ) h.join();
+	}
+};
+
+template <class F> static double measure( int repeats, F f )
+{
+	auto t0 = std::chrono::steady_clock::now();
+	for( int r=0; r < repeats; r++ ) f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now()-t0).count();
+}
+
+int main( int argc, char* argv[] )
+{
+	int repeats = argc>1 ? atoi(argv[1]) : 200;
+#if defined(CGMATH_AVX)
+	const char* isa = "AVX";
+#elif defined(CGMATH_SSE)
+	const char* isa = "SSE";
+#elif defined(CGMATH_NEON)
+	const char* isa = "NEON";
+#else
+	const char* isa = "scalar";
+#endif
+	printf( "> mat4 products: %s%s, %d repeats\n", isa, alignof(mat4)==16?" (aligned)":"", repeats );
+
+	// random parameters and points
+	const size_t n = 4096; srand(0);
+	auto rnd = [](){ return rand()/float(RAND_MAX)*2.0f-1.0f; };
+	std::vector<trs_t> params(n); std::vector<vec4> points(n);
+	for( size_t k=0; k < n; k++ ){ params[k] = { vec3(rnd(),rnd(),rnd())*300.0f, vec3(rnd(),rnd(),rnd()), vec3(rnd(),rnd(),rnd()).normalize(), rnd()*PI }; points[k] = vec4(rnd(),rnd(),rnd(),1.0f)*100.0f; }
+
+	// chained TRS compositions: three products per composition
+	std::vector<mat4> m0(n), m1(n);
+	auto ref = []( const mat4& l, const mat4& r ){ return ref_mul(l,r); };
+	auto cur = []( const mat4& l, const mat4& r ){ return l*r; };
+	double t0 = measure( repeats, [&](){ for( size_t k=0; k < n; k++ ) m0[k] = compose( params[k], ref ); } );
+	double t1 = measure( repeats, [&](){ for( size_t k=0; k < n; k++ ) m1[k] = compose( params[k], cur ); } );
+	float e=0; for( size_t k=0; k < n; k++ ) for( int j=0; j < 16; j++ ) e = std::max( e, fabs(m0[k][j]-m1[k][j]) );
+	double c = double(n)*repeats/1e6;
+	printf( "  TRS compositions: %8.2f -> %8.2f M/s (x%.2f), max diff = %g\n", c/t0, c/t1, t0/t1, e );
+
+	// the same rigid transformations in dual quaternions: chained products, and the rotation about a pivot built directly
+	std::vector<mat4> m2(n), m3(n);
+	double t2 = measure( repeats, [&](){ for( size_t k=0; k < n; k++ ){ const trs_t& p=params[k]; m2[k] = (dquat::translate(p.move)*dquat::translate(p.at)*dquat::rotate(p.axis,p.theta)*dquat::translate(-p.at)).to_mat4(); } } );
+	t1 = measure( repeats, [&](){ for( size_t k=0; k < n; k++ ){ const trs_t& p=params[k]; quat r=quat::rotate(p.axis,p.theta); m3[k] = dquat(r,p.move+p.at-r*p.at).to_mat4(); } } );
+	e=0; for( size_t k=0; k < n; k++ ) for( int j=0; j < 16; j++ ) e = std::max( e, std::max(fabs(m0[k][j]-m2[k][j]),fabs(m0[k][j]-m3[k][j]))/std::max(1.0f,fabs(m0[k][j])) );
+	printf( "  dquat chains:     %8.2f -> %8.2f M/s (x%.2f), pivot: %.2f M/s (x%.2f), max rel. diff = %g\n", c/t0, c/t2, t0/t2, c/t1, t0/t1, e );
+
+	// mat4*vec4 with the composed matrices
+	std::vector<vec4> v0(n), v1(n);
+	t0 = measure( repeats*4, [&](){ for( size_t k=0; k < n; k++ ) v0[k] = ref_mul( m0[k], points[k] ); } );
+	t1 = measure( repeats*4, [&](){ for( size_t k=0; k < n; k++ ) v1[k] = m0[k]*points[k]; } );
+	e=0; for( size_t k=0; k < n; k++ ) for( int j=0; j < 4; j++ ) e = std::max( e, fabs(v0[k][j]-v1[k][j]) );
+	printf( "  mat4*vec4:        %8.2f -> %8.2f M/s (x%.2f), max diff = %g\n", c*4/t0, c*4/t1, t0/t1, e );
+
+	// per-frame inverses: view matrices from look_at() and normal matrices of TRS model matrices
+	std::vector<mat4> views(n), i0(n), i1(n); std::vector<mat3> n0(n), n1(n);
+	for( size_t k=0; k < n; k++ ) views[k] = mat4::look_at( params[k].move, params[k].at, vec3(0,1,0) );
+	auto inverse = [&]( const char* name, auto f0, auto f1, auto& o0, auto& o1 )
+	{
+		t0 = measure( repeats, f0 ); t1 = measure( repeats, f1 ); e=0;
+		for( size_t k=0; k < n; k++ ) for( int j=0; j < int(sizeof(o0[k])/sizeof(float)); j++ ) e = std::max( e, fabs(o0[k][j]-o1[k][j])/std::max(1.0f,fabs(o0[k][j])) );
+		printf( "  %-17s %8.2f -> %8.2f M/s (x%.2f), max rel. diff = %g\n", name, c/t0, c/t1, t0/t1, e );
+	};
+	inverse( "view inverse:", [&](){ for( size_t k=0; k < n; k++ ) i0[k] = views[k].inverse(); }, [&](){ for( size_t k=0; k < n; k++ ) i1[k] = views[k].inverse_rigid(); }, i0, i1 );
+	inverse( "model inverse:", [&](){ for( size_t k=0; k < n; k++ ) i0[k] = m0[k].inverse(); }, [&](){ for( size_t k=0; k < n; k++ ) i1[k] = m0[k].inverse_affine(); }, i0, i1 );
+	inverse( "normal matrix:", [&](){ for( size_t k=0; k < n; k++ ) n0[k] = mat3(m0[k].inverse()).transpose(); }, [&](){ for( size_t k=0; k < n; k++ ) n1[k] = normal_matrix(m0[k]); }, n0, n1 );
+
+	// batched transformations of point arrays: per-point operators against transform_points() and friends
+	const size_t np = 1<<20; std::vector<vec3> p(np), q0(np), q1(np); std::vector<vec4> h(np), h0(np), h1(np);
+	for( size_t k=0; k < np; k++ ){ p[k] = vec3(rnd(),rnd(),rnd())*100.0f; h[k] = vec4(p[k],1.0f); }
+	mat4 m = m0[0], proj = mat4::perspective( PI/6.0f, 1.0f, 1.0f, 1000.0f )*mat4::look_at( vec3(0,0,400), vec3(0,0,0), vec3(0,1,0) );
+	mat3 nm = normal_matrix(m); threads_t threads;
+	c = double(np)*repeats/200/1e6; int rb = std::max(1,repeats/200);
+	auto batch = [&]( const char* name, auto f0, auto f1, auto& o0, auto& o1 )
+	{
+		t0 = measure( rb, f0 ); t1 = measure( rb, f1 ); e=0;
+		for( size_t k=0; k < np; k++ ) for( int j=0; j < int(sizeof(o0[k])/sizeof(float)); j++ ) e = std::max( e, fabs(o0[k][j]-o1[k][j]) );
+		printf( "  %-17s %8.2f -> %8.2f M/s (x%.2f), max diff = %g\n", name, c/t0, c/t1, t0/t1, e );
+	};
+	batch( "points:", [&](){ for( size_t k=0; k < np; k++ ) q0[k] = m*p[k]; }, [&](){ transform_points( m, p.data(), q1.data(), np ); }, q0, q1 );
+	batch( "normals:", [&](){ for( size_t k=0; k < np; k++ ) q0[k] = (nm*p[k]).normalize(); }, [&](){ transform_normals( m, p.data(), q1.data(), np ); }, q0, q1 );
+	batch( "homogeneous:", [&](){ for( size_t k=0; k < np; k++ ) h0[k] = m*h[k]; }, [&](){ transform_points( m, h.data(), h1.data(), np ); }, h0, h1 );
+	batch( "projection:", [&](){ for( size_t k=0; k < np; k++ ){ vec4 v=proj*vec4(p[k],1.0f); q0[k] = vec3(v.x,v.y,v.z)/v.w; } }, [&](){ project_points( proj, p.data(), q1.data(), np ); }, q0, q1 );
+	batch( "points (threads):", [&](){ transform_points( m, p.data(), q0.data(), np ); }, [&](){ transform_points( m, p.data(), q1.data(), np, &threads ); }, q0, q1 );
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+// meshpack: converts a raw vertex/index binary pair into a single mesh pack file (see cgpack.h)
+// usage: meshpack <vertex.bin> <index.bin> <output.pack.bin> [--float] [--raw] [--no-optimize]
+#include "cgmath.h"		// slee's simple math library
+#include "cgut.h"		// slee's OpenGL utility
+#include "cgpack.h"		// mesh pack container
+
+// paths in the command line are relative to the current directory, not to the executable
+static std::string full_path( const char* path )
+{
+#if defined(_WIN32)
+	char f[MAX_PATH]; return _fullpath( f, path, MAX_PATH ) ? f : path;
+#else
+	if(*path=='/') return path;
+	char d[MAX_PATH]; return getcwd(d,MAX_PATH) ? std::string(d)+"/"+path : path;
+#endif
+}
+
+int main( int argc, char* argv[] )
+{
+	std::vector<std::string> paths; bool b_packed=true, b_delta=true, b_optimize=true;
+	for( int k=1; k < argc; k++ )
+	{
+		if(strcmp(argv[k],"--float")==0)			b_packed = false;
+		else if(strcmp(argv[k],"--raw")==0)			b_delta = false;
+		else if(strcmp(argv[k],"--no-optimize")==0)	b_optimize = false;
+		else paths.emplace_back( full_path(argv[k]) );
+	}
+	if(paths.size()!=3){ printf( "usage: %s <vertex.bin> <index.bin> <output.pack.bin> [--float] [--raw] [--no-optimize]\n", argv[0] ); return 1; }
+
+	// load and optimize the raw binaries
+	std::vector<vertex> v; std::vector<uint> i;
+	if(!cg_load_vertices( paths[0].c_str(), &v )||!cg_load_indices( paths[1].c_str(), &i )) return 1;
+	for( uint j : i ) if(j>=v.size()){ printf( "error: index %u out of %zu vertices\n", j, v.size() ); return 1; }
+	if(b_optimize)
+	{
+		auto r = cg_optimize_mesh( v, i );
+		printf( "> optimized: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", r.first.acmr, r.second.acmr, r.first.atvr, r.second.atvr );
+	}
+
+	// vertex layout and AABB
+	std::vector<packed_vertex> p; vec3 lo, hi;
+	if(b_packed){ vertex_quant q = cg_pack_vertices( v.data(), v.size(), p ); lo = q.offset; hi = q.offset+q.scale; }
+	else
+	{
+		lo = hi = v.empty() ? vec3(0,0,0) : v[0].pos;
+		for( auto& u : v ) for( int d=0; d < 3; d++ ){ lo[d]=std::min(lo[d],u.pos[d]); hi[d]=std::max(hi[d],u.pos[d]); }
+	}
+	const void* vp = b_packed ? (const void*) p.data() : (const void*) v.data();
+	uint layout = b_packed ? PACK_LAYOUT_PACKED : PACK_LAYOUT_VERTEX;
+	if(!cg_save_mesh_pack( paths[2].c_str(), vp, v.size(), layout, i.data(), i.size(), lo, hi, b_delta?PACK_ENCODING_DELTA:PACK_ENCODING_RAW )) return 1;
+
+	// verify the round trip by the streaming decoder in small chunks
+	mem_t m = cg_read_binary( paths[2].c_str() ); if(!m.ptr) return 1;
+	mesh_pack_header h; memcpy( (void*) &h, m.ptr, sizeof(h) );
+	if(!cg_validate_pack_header( h, paths[2].c_str() )) return 1;
+	size_t vbytes=size_t(h.vertex_count)*h.vertex_stride, raw_bytes=v.size()*sizeof(vertex)+i.size()*sizeof(uint);
+	std::vector<uchar> vd(vbytes); std::vector<uint> id(h.index_count);
+	mesh_pack_decoder d( h, vd.data(), id.data() ); bool b = true;
+	for( size_t k=sizeof(h); b&&k < m.size; k+=4096 ) b = d.feed( (const uchar*)m.ptr+k, std::min(size_t(4096),m.size-k) );
+	b = b&&d.valid()&&memcmp(vd.data(),vp,vbytes)==0&&id==i;
+	printf( "> %s: %s layout, %s encoding, %zu vertices, %zu indices\n", paths[2].c_str(), b_packed?"packed":"float", b_delta?"delta":"raw", v.size(), i.size() );
+	printf( "  %zu -> %zu bytes (%.1f%%), round trip %s\n", raw_bytes, m.size, 100.0*m.size/raw_bytes, b?"verified":"FAILED" );
+	free( m.ptr );
+
+	return b ? 0 : 1;
+}
\ No newline at end of file
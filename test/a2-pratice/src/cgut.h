@@ -223,14 +223,39 @@ struct image
 	GLint format(){ return channels==1?GL_RED:channels==2?GL_RG:channels==3?GL_RGB:GL_RGBA; }
 };
 
+// bounding volumes of a mesh in object space for culling
+struct mesh_bounds
+{
+	vec3	box_min = vec3(0,0,0), box_max = vec3(0,0,0);	// AABB
+	vec4	sphere = vec4(0,0,0,0);							// (center, radius) around the center of AABB
+
+	void update( const vertex* v, size_t n )
+	{
+		if(!n) return;
+		box_min = box_max = v[0].pos;
+		for( size_t k=1; k < n; k++ ) for( int d=0; d < 3; d++ ){ box_min[d] = std::min(box_min[d],v[k].pos[d]); box_max[d] = std::max(box_max[d],v[k].pos[d]); }
+		vec3 c = (box_min+box_max)*0.5f; float r2=0;
+		for( size_t k=0; k < n; k++ ){ vec3 d=v[k].pos-c; r2 = std::max(r2,d.x*d.x+d.y*d.y+d.z*d.z); }
+		sphere = vec4( c.x, c.y, c.z, sqrtf(r2) );
+	}
+	void set_box( const vec3& bmin, const vec3& bmax ) // without vertices: the sphere circumscribes the box
+	{
+		box_min = bmin; box_max = bmax; vec3 c = (bmin+bmax)*0.5f, e = (bmax-bmin)*0.5f;
+		sphere = vec4( c.x, c.y, c.z, sqrtf(e.x*e.x+e.y*e.y+e.z*e.z) );
+	}
+};
+
 struct mesh
 {
 	std::vector<vertex>	vertex_list;
 	std::vector<uint>	index_list;
+	uint	vertex_count = 0;
+	uint	index_count = 0;
 	GLuint	vertex_buffer = 0;
 	GLuint	index_buffer = 0;
 	GLuint	vertex_array = 0;
 	GLuint	texture = 0;
+	mesh_bounds	bounds;	// AABB and bounding sphere
 
 	~mesh()
 	{
@@ -590,6 +615,8 @@ inline mesh* cg_load_mesh( const char* vert_binary_path, const char* index_binar
 	// load vertex/index buffers
 	if(!cg_load_vertices( vert_binary_path, &new_mesh->vertex_list )) return nullptr;
 	if(!cg_load_indices( index_binary_path, &new_mesh->index_list )) return nullptr;
+	new_mesh->vertex_count = uint(new_mesh->vertex_list.size());
+	new_mesh->index_count = uint(new_mesh->index_list.size());
 
 	// create a vertex buffer
 	glGenBuffers( 1, &new_mesh->vertex_buffer );